@@ -68,7 +68,7 @@ MAModel* GetClassifier(const QString& resource_str)
 }
 
 AudioWatcher::AudioWatcher(const QString& audio_file) : AudioFile(audio_file), Device(NULL),
-  AudioAnalyzer(SampleRate, 5), BufferPos(0)
+  AudioAnalyzer(SampleRate, 5), BufferPos(0), Idle(false)
 {
   // Load the classifiers
   ClassifierTree.reset(GetClassifier(":/pingpongsound_dt.mdl"));
@@ -105,6 +105,16 @@ AudioWatcher::~AudioWatcher()
 }
 
 
+void AudioWatcher::SetIdle(bool idle)
+{
+  if (Idle == idle)
+    return;
+
+  Idle = idle;
+  printf("Audio classification %s\n", Idle ? "suspended" : "resumed");
+}
+
+
 void AudioWatcher::StartPlayback()
 {
   if (!PlaybackClock.isValid())
@@ -176,7 +186,8 @@ RecognitionResult AudioWatcher::DoRecognition()
   // Convert the data to double
   double Power = MCCalculateVectorStatistic(Buffer, *new MCPower<double>)*100000;
 
-  if (Power < 50)
+  // Only the power gate runs while the table is idle
+  if (Power < 50 || Idle)
     return RecognitionResult(1.0, 1.0);
 //  printf("Power: %1.12f\n", Power);
 
@@ -47,6 +47,8 @@ public:
   AudioWatcher(const QString& audio_file);
   virtual ~AudioWatcher();
 
+  void SetIdle(bool idle);
+
 public Q_SLOTS:
   void StartPlayback();
   void AudioUpdate();
@@ -70,6 +72,7 @@ protected:
   MC::DoubleList Buffer;
   int BufferPos;
   MC::DoubleList WavBuffer;
+  bool Idle;
 };
 
 #endif
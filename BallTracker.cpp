@@ -0,0 +1,342 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "BallTracker.hpp"
+
+#include <MEImage.hpp>
+
+#include <opencv/cv.h>
+
+#include <algorithm>
+#include <math.h>
+
+BallTracker::BallTracker() : ForegroundThreshold(25), WarmUpFrames(10), MinBallArea(3), MaxBallArea(120),
+  MaxBallSize(24), MaxRunCount(4000), MaxMissedFrames(5), InitDistance(60), GateRadius(15), Alpha(0.85),
+  Beta(0.5), RegionX1(0), RegionY1(0), RegionX2(-1), RegionY2(-1), Width(0), Height(0), FrameCount(0),
+  PreviousTimestamp(0), Tracking(false), MissedFrames(0)
+{
+}
+
+
+BallTracker::~BallTracker()
+{
+}
+
+
+void BallTracker::Reset()
+{
+  FrameCount = 0;
+  Tracking = false;
+  MissedFrames = 0;
+  CandidatesX.clear();
+  CandidatesY.clear();
+  PreviousCandidatesX.clear();
+  PreviousCandidatesY.clear();
+  Ball = Position();
+}
+
+
+void BallTracker::SetRegion(int x1, int y1, int x2, int y2)
+{
+  if (x1 == RegionX1 && y1 == RegionY1 && x2 == RegionX2 && y2 == RegionY2)
+    return;
+
+  RegionX1 = x1;
+  RegionY1 = y1;
+  RegionX2 = x2;
+  RegionY2 = y2;
+  Reset();
+}
+
+
+bool BallTracker::Track(const MEImage& image, int timestamp)
+{
+  const int X1 = std::max(RegionX1, 0);
+  const int Y1 = std::max(RegionY1, 0);
+  const int X2 = std::min(RegionX2, image.GetWidth()-1);
+  const int Y2 = std::min(RegionY2, image.GetHeight()-1);
+
+  if (X2-X1 < 8 || Y2-Y1 < 8)
+    return false;
+
+  if (Width != X2-X1+1 || Height != Y2-Y1+1)
+  {
+    Width = X2-X1+1;
+    Height = Y2-Y1+1;
+    Background.resize(Width*Height);
+    Mask.resize(Width*Height);
+    Reset();
+  }
+  UpdateBackground(image);
+  FrameCount++;
+  if (FrameCount <= WarmUpFrames)
+    return false;
+
+  if (!FindCandidates())
+  {
+    // Too much foreground (e.g. the lighting changed), learn the background again
+    Reset();
+    return false;
+  }
+  UpdateTrack(timestamp);
+  PreviousCandidatesX.swap(CandidatesX);
+  PreviousCandidatesY.swap(CandidatesY);
+  PreviousTimestamp = timestamp;
+  return Tracking;
+}
+
+
+bool BallTracker::IsTracking() const
+{
+  return Tracking;
+}
+
+
+const BallTracker::Position& BallTracker::GetPosition() const
+{
+  return Ball;
+}
+
+
+void BallTracker::UpdateBackground(const MEImage& image)
+{
+  const IplImage* Source = image.GetIplImage();
+  const int Channels = Source->nChannels;
+  const int X1 = std::max(RegionX1, 0);
+  const int Y1 = std::max(RegionY1, 0);
+  // The background is stored with 4 fractional bits
+  const int Threshold = ForegroundThreshold << 4;
+
+  for (int y = 0; y < Height; ++y)
+  {
+    const unsigned char* Row = (const unsigned char*)Source->imageData+(Y1+y)*Source->widthStep+X1*Channels;
+    unsigned short* BackgroundRow = &Background[y*Width];
+    unsigned char* MaskRow = &Mask[y*Width];
+
+    for (int x = 0; x < Width; ++x)
+    {
+      const unsigned char* Pixel = Row+x*Channels;
+      // BGR pixel order
+      const int Luma = (Channels == 1 ? Pixel[0] : (29*Pixel[0]+150*Pixel[1]+77*Pixel[2]) >> 8) << 4;
+
+      if (FrameCount == 0)
+      {
+        BackgroundRow[x] = (unsigned short)Luma;
+        MaskRow[x] = 0;
+        continue;
+      }
+      const int Difference = Luma-BackgroundRow[x];
+      const bool Foreground = Difference > Threshold || Difference < -Threshold;
+
+      MaskRow[x] = Foreground ? 1 : 0;
+      // Selective update: the foreground is learned much slower than the background
+      BackgroundRow[x] = (unsigned short)(BackgroundRow[x]+(Foreground ? Difference / 128 : Difference / 16));
+    }
+  }
+}
+
+
+bool BallTracker::FindCandidates()
+{
+  CandidatesX.clear();
+  CandidatesY.clear();
+  Runs.clear();
+  Parents.clear();
+  // Collect the foreground runs and connect them to the overlapping runs of the previous row (8-connectivity)
+  int PreviousStart = 0;
+  int PreviousEnd = 0;
+
+  for (int y = 0; y < Height; ++y)
+  {
+    const unsigned char* MaskRow = &Mask[y*Width];
+    const int RowStart = (int)Runs.size();
+    int Previous = PreviousStart;
+    int x = 0;
+
+    while (x < Width)
+    {
+      if (!MaskRow[x])
+      {
+        x++;
+        continue;
+      }
+      Run NewRun;
+
+      NewRun.Y = y;
+      NewRun.X1 = x;
+      while (x < Width && MaskRow[x])
+        x++;
+      NewRun.X2 = x-1;
+      if ((int)Runs.size() >= MaxRunCount)
+        return false;
+
+      const int Index = (int)Runs.size();
+
+      Runs.push_back(NewRun);
+      Parents.push_back(Index);
+      while (Previous < PreviousEnd && Runs[Previous].X2 < NewRun.X1-1)
+        Previous++;
+      for (int i = Previous; i < PreviousEnd && Runs[i].X1 <= NewRun.X2+1; ++i)
+      {
+        const int Root1 = FindRoot(i);
+        const int Root2 = FindRoot(Index);
+
+        if (Root1 != Root2)
+          Parents[std::max(Root1, Root2)] = std::min(Root1, Root2);
+      }
+    }
+    PreviousStart = RowStart;
+    PreviousEnd = (int)Runs.size();
+  }
+  // Blob statistics per root run
+  Blobs.resize(Runs.size());
+  for (int i = 0; i < (int)Runs.size(); ++i)
+  {
+    Blob& Item = Blobs[i];
+
+    Item.Area = 0;
+    Item.SumX = Item.SumY = 0;
+    Item.MinX = Item.MinY = 1 << 30;
+    Item.MaxX = Item.MaxY = -1;
+  }
+  for (int i = 0; i < (int)Runs.size(); ++i)
+  {
+    const Run& Segment = Runs[i];
+    Blob& Item = Blobs[FindRoot(i)];
+    const int Length = Segment.X2-Segment.X1+1;
+
+    Item.Area += Length;
+    Item.SumX += (Segment.X1+Segment.X2)*Length / 2;
+    Item.SumY += Segment.Y*Length;
+    Item.MinX = std::min(Item.MinX, Segment.X1);
+    Item.MaxX = std::max(Item.MaxX, Segment.X2);
+    Item.MinY = std::min(Item.MinY, Segment.Y);
+    Item.MaxY = std::max(Item.MaxY, Segment.Y);
+  }
+  // The ball is a small and compact blob (it is elongated by the motion blur at most)
+  for (int i = 0; i < (int)Runs.size(); ++i)
+  {
+    const Blob& Item = Blobs[i];
+
+    if (Parents[i] != i || Item.Area < MinBallArea || Item.Area > MaxBallArea)
+      continue;
+
+    const int BlobWidth = Item.MaxX-Item.MinX+1;
+    const int BlobHeight = Item.MaxY-Item.MinY+1;
+
+    if (BlobWidth > MaxBallSize || BlobHeight > MaxBallSize || Item.Area*3 < BlobWidth*BlobHeight)
+      continue;
+
+    CandidatesX.push_back((float)Item.SumX / Item.Area+std::max(RegionX1, 0));
+    CandidatesY.push_back((float)Item.SumY / Item.Area+std::max(RegionY1, 0));
+  }
+  return true;
+}
+
+
+int BallTracker::FindRoot(int index)
+{
+  while (Parents[index] != index)
+  {
+    Parents[index] = Parents[Parents[index]];
+    index = Parents[index];
+  }
+  return index;
+}
+
+
+void BallTracker::UpdateTrack(int timestamp)
+{
+  const float TimeStep = (float)std::max(timestamp-(Tracking ? Ball.Timestamp : PreviousTimestamp), 1);
+  int Best = -1;
+  float BestDistance = 0;
+
+  if (!Tracking)
+  {
+    // Start a track from two candidates of consecutive frames
+    for (int i = 0; i < (int)CandidatesX.size(); ++i)
+    {
+      for (int p = 0; p < (int)PreviousCandidatesX.size(); ++p)
+      {
+        const float DiffX = CandidatesX[i]-PreviousCandidatesX[p];
+        const float DiffY = CandidatesY[i]-PreviousCandidatesY[p];
+        const float Distance = sqrtf(DiffX*DiffX+DiffY*DiffY);
+
+        // A static blob is not the ball
+        if (Distance < 1 || Distance > InitDistance || (Best >= 0 && Distance >= BestDistance))
+          continue;
+
+        Best = i;
+        BestDistance = Distance;
+        Ball.VelocityX = DiffX / TimeStep;
+        Ball.VelocityY = DiffY / TimeStep;
+      }
+    }
+    if (Best < 0)
+      return;
+
+    Tracking = true;
+    MissedFrames = 0;
+    Ball.Timestamp = timestamp;
+    Ball.X = CandidatesX[Best];
+    Ball.Y = CandidatesY[Best];
+    Ball.Measured = true;
+    return;
+  }
+  // Predict the position with constant velocity and associate the nearest candidate in the gate
+  const float PredictedX = Ball.X+Ball.VelocityX*TimeStep;
+  const float PredictedY = Ball.Y+Ball.VelocityY*TimeStep;
+  const float Speed = sqrtf(Ball.VelocityX*Ball.VelocityX+Ball.VelocityY*Ball.VelocityY);
+  const float Gate = GateRadius+Speed*TimeStep / 2;
+
+  for (int i = 0; i < (int)CandidatesX.size(); ++i)
+  {
+    const float DiffX = CandidatesX[i]-PredictedX;
+    const float DiffY = CandidatesY[i]-PredictedY;
+    const float Distance = sqrtf(DiffX*DiffX+DiffY*DiffY);
+
+    if (Distance > Gate || (Best >= 0 && Distance >= BestDistance))
+      continue;
+
+    Best = i;
+    BestDistance = Distance;
+  }
+  Ball.Timestamp = timestamp;
+  if (Best < 0)
+  {
+    // Coast on the prediction for a few frames
+    Ball.X = PredictedX;
+    Ball.Y = PredictedY;
+    Ball.Measured = false;
+    if (++MissedFrames > MaxMissedFrames)
+      Tracking = false;
+    return;
+  }
+  const float ResidualX = CandidatesX[Best]-PredictedX;
+  const float ResidualY = CandidatesY[Best]-PredictedY;
+
+  Ball.X = PredictedX+Alpha*ResidualX;
+  Ball.Y = PredictedY+Alpha*ResidualY;
+  Ball.VelocityX += Beta*ResidualX / TimeStep;
+  Ball.VelocityY += Beta*ResidualY / TimeStep;
+  Ball.Measured = true;
+  MissedFrames = 0;
+}
@@ -0,0 +1,111 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef BallTracker_hpp
+#define BallTracker_hpp
+
+#include <vector>
+
+class MEImage;
+
+/**
+ * Ball tracking on every captured frame inside the table region.
+ *
+ * The foreground is the difference to a running-average background of the
+ * luma plane (fixed point, selective update). The foreground pixels are
+ * grouped into blobs with run-length union-find, the ball candidates are the
+ * small and compact blobs. A constant-velocity alpha-beta tracker associates
+ * the candidate nearest to its prediction and coasts over a few missed frames.
+ */
+class BallTracker
+{
+public:
+  struct Position
+  {
+    Position() : Timestamp(0), X(0), Y(0), VelocityX(0), VelocityY(0), Measured(false) {}
+
+    int Timestamp;
+    float X;
+    float Y;
+    // Pixels per millisecond
+    float VelocityX;
+    float VelocityY;
+    bool Measured;
+  };
+
+  BallTracker();
+  virtual ~BallTracker();
+
+  void Reset();
+  void SetRegion(int x1, int y1, int x2, int y2);
+  bool Track(const MEImage& image, int timestamp);
+  bool IsTracking() const;
+  const Position& GetPosition() const;
+
+private:
+  struct Run
+  {
+    int Y, X1, X2;
+  };
+
+  struct Blob
+  {
+    int Area;
+    int SumX, SumY;
+    int MinX, MinY, MaxX, MaxY;
+  };
+
+  void UpdateBackground(const MEImage& image);
+  bool FindCandidates();
+  int FindRoot(int index);
+  void UpdateTrack(int timestamp);
+
+protected:
+  const int ForegroundThreshold;
+  const int WarmUpFrames;
+  const int MinBallArea;
+  const int MaxBallArea;
+  const int MaxBallSize;
+  const int MaxRunCount;
+  const int MaxMissedFrames;
+  const float InitDistance;
+  const float GateRadius;
+  const float Alpha;
+  const float Beta;
+  int RegionX1, RegionY1, RegionX2, RegionY2;
+  int Width, Height;
+  int FrameCount;
+  std::vector<unsigned short> Background;
+  std::vector<unsigned char> Mask;
+  std::vector<Run> Runs;
+  std::vector<int> Parents;
+  std::vector<Blob> Blobs;
+  std::vector<float> CandidatesX;
+  std::vector<float> CandidatesY;
+  std::vector<float> PreviousCandidatesX;
+  std::vector<float> PreviousCandidatesY;
+  int PreviousTimestamp;
+  bool Tracking;
+  int MissedFrames;
+  Position Ball;
+};
+
+#endif
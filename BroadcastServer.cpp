@@ -0,0 +1,411 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "BroadcastServer.hpp"
+
+#include "ImageSender.hpp"
+
+#include <MCLog.hpp>
+
+#include <QMutexLocker>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace
+{
+// Size of the length prefix before every frame
+const int HeaderSize = 4;
+// Frames waiting for a subscriber beside the one in progress
+const int MaxQueuedFrames = 2;
+const int MaxEvents = 32;
+// Timeout of the event loop, the stop flag is checked at least this often (ms)
+const int EventTimeout = 1000;
+// Period of the statistics report (ms)
+const int StatisticsInterval = 10000;
+
+
+bool SetNonBlocking(int socket)
+{
+  const int Flags = fcntl(socket, F_GETFL, 0);
+
+  return Flags >= 0 && fcntl(socket, F_SETFL, Flags | O_NONBLOCK) == 0;
+}
+}
+
+BroadcastServer::BroadcastServer(int port, EncodedFrameCache& cache, int bytes_per_second) : QThread(), Port(port),
+  ListenSocket(-1), EpollDescriptor(-1), WakeDescriptor(-1), Stopping(0), SubscriberCount(0)
+{
+  sockaddr_in Address;
+  const int Reuse = 1;
+  epoll_event Event;
+
+  Clock.start();
+  StatisticsTimer.start();
+  // The encoded frames are published to the subscribers from the encoder thread
+  Encoder.reset(new ImageEncoder(Mailbox, cache, Clock, bytes_per_second, false));
+  connect(Encoder.get(), SIGNAL(FrameEncoded(QByteArray, qint64)),
+          this, SLOT(Publish(QByteArray, qint64)), Qt::DirectConnection);
+
+  ListenSocket = socket(AF_INET, SOCK_STREAM, 0);
+  EpollDescriptor = epoll_create1(0);
+  WakeDescriptor = eventfd(0, EFD_NONBLOCK);
+  if (ListenSocket < 0 || EpollDescriptor < 0 || WakeDescriptor < 0)
+  {
+    MC_LOG("Broadcast server cannot be created: %s", strerror(errno));
+    if (ListenSocket >= 0)
+      close(ListenSocket);
+    ListenSocket = -1;
+    return;
+  }
+  memset(&Address, 0, sizeof(Address));
+  Address.sin_family = AF_INET;
+  Address.sin_addr.s_addr = htonl(INADDR_ANY);
+  Address.sin_port = htons(Port);
+  setsockopt(ListenSocket, SOL_SOCKET, SO_REUSEADDR, &Reuse, sizeof(Reuse));
+  if (bind(ListenSocket, (sockaddr*)&Address, sizeof(Address)) != 0 || listen(ListenSocket, 16) != 0 ||
+      !SetNonBlocking(ListenSocket))
+  {
+    MC_LOG("Broadcast server cannot listen on port %d: %s", Port, strerror(errno));
+    close(ListenSocket);
+    ListenSocket = -1;
+    return;
+  }
+  memset(&Event, 0, sizeof(Event));
+  Event.events = EPOLLIN;
+  Event.data.fd = ListenSocket;
+  epoll_ctl(EpollDescriptor, EPOLL_CTL_ADD, ListenSocket, &Event);
+  Event.data.fd = WakeDescriptor;
+  epoll_ctl(EpollDescriptor, EPOLL_CTL_ADD, WakeDescriptor, &Event);
+  MC_LOG("Broadcast server listens on port %d", Port);
+  Encoder->start();
+  start();
+}
+
+
+BroadcastServer::~BroadcastServer()
+{
+  Mailbox.Close();
+  Encoder->wait();
+  Stopping.store(1);
+  if (isRunning())
+  {
+    Wake();
+    wait();
+  }
+  while (!Subscribers.empty())
+    CloseSubscriber(Subscribers.begin()->first);
+  if (ListenSocket >= 0)
+    close(ListenSocket);
+  if (EpollDescriptor >= 0)
+    close(EpollDescriptor);
+  if (WakeDescriptor >= 0)
+    close(WakeDescriptor);
+}
+
+
+bool BroadcastServer::IsListening() const
+{
+  return ListenSocket >= 0;
+}
+
+
+void BroadcastServer::SendFrame(const FrameHandle& frame)
+{
+  // Nothing is encoded without subscribers
+  if (SubscriberCount.load() == 0)
+    return;
+
+  Mailbox.Post(frame);
+}
+
+
+void BroadcastServer::Publish(const QByteArray& data, qint64 encode_start)
+{
+  Q_UNUSED(encode_start);
+
+  {
+    QMutexLocker Lock(&PendingMutex);
+
+    PendingFrame = data;
+  }
+  Wake();
+}
+
+
+void BroadcastServer::run()
+{
+  epoll_event Events[MaxEvents];
+
+  while (Stopping.load() == 0)
+  {
+    const int EventCount = epoll_wait(EpollDescriptor, Events, MaxEvents, EventTimeout);
+
+    if (EventCount < 0 && errno != EINTR)
+    {
+      MC_LOG("Broadcast server event loop failed: %s", strerror(errno));
+      break;
+    }
+    for (int i = 0; i < EventCount; ++i)
+    {
+      const int Descriptor = Events[i].data.fd;
+
+      if (Descriptor == ListenSocket)
+      {
+        AcceptSubscribers();
+        continue;
+      }
+      if (Descriptor == WakeDescriptor)
+      {
+        uint64_t Counter;
+
+        while (read(WakeDescriptor, &Counter, sizeof(Counter)) > 0)
+          ;
+        DistributeFrame();
+        continue;
+      }
+      SubscriberMap::iterator Iter = Subscribers.find(Descriptor);
+
+      if (Iter == Subscribers.end())
+        continue;
+
+      bool Failed = (Events[i].events & (EPOLLERR | EPOLLHUP)) != 0;
+
+      // The subscribers do not send anything, the reads only notice the disconnection
+      if (!Failed && (Events[i].events & EPOLLIN))
+      {
+        char Buffer[256];
+        ssize_t Result;
+
+        while ((Result = recv(Descriptor, Buffer, sizeof(Buffer), 0)) > 0)
+          ;
+        Failed = Result == 0 || (errno != EAGAIN && errno != EWOULDBLOCK);
+      }
+      if (!Failed && (Events[i].events & EPOLLOUT))
+        Failed = !FlushSubscriber(*Iter->second);
+      if (Failed)
+        CloseSubscriber(Descriptor);
+    }
+    if (StatisticsTimer.elapsed() >= StatisticsInterval)
+    {
+      ReportStatistics();
+      StatisticsTimer.start();
+    }
+  }
+}
+
+
+void BroadcastServer::AcceptSubscribers()
+{
+  sockaddr_in Address;
+  socklen_t AddressLength = sizeof(Address);
+  int Socket;
+
+  while ((Socket = accept(ListenSocket, (sockaddr*)&Address, &AddressLength)) >= 0)
+  {
+    SubscriberSPtr NewSubscriber(new Subscriber);
+    char AddressText[INET_ADDRSTRLEN];
+    char PortText[8];
+    epoll_event Event;
+
+    SetNonBlocking(Socket);
+    NewSubscriber->Socket = Socket;
+    inet_ntop(AF_INET, &Address.sin_addr, AddressText, sizeof(AddressText));
+    snprintf(PortText, sizeof(PortText), "%d", (int)ntohs(Address.sin_port));
+    NewSubscriber->Address = std::string(AddressText)+":"+PortText;
+    NewSubscriber->Offset = 0;
+    NewSubscriber->WaitingWritable = false;
+    NewSubscriber->BytesSent = 0;
+    NewSubscriber->FramesSent = 0;
+    NewSubscriber->FramesDropped = 0;
+    memset(&Event, 0, sizeof(Event));
+    Event.events = EPOLLIN;
+    Event.data.fd = Socket;
+    epoll_ctl(EpollDescriptor, EPOLL_CTL_ADD, Socket, &Event);
+    Subscribers[Socket] = NewSubscriber;
+    SubscriberCount.store((int)Subscribers.size());
+    MC_LOG("Broadcast subscriber connected: %s", NewSubscriber->Address.c_str());
+    AddressLength = sizeof(Address);
+  }
+}
+
+
+void BroadcastServer::DistributeFrame()
+{
+  QByteArray Frame;
+
+  {
+    QMutexLocker Lock(&PendingMutex);
+
+    Frame = PendingFrame;
+    PendingFrame = QByteArray();
+  }
+  if (Frame.isEmpty())
+    return;
+
+  std::vector<int> FailedSockets;
+
+  // The subscribers share the same encoded data
+  for (SubscriberMap::iterator Iter = Subscribers.begin(); Iter != Subscribers.end(); ++Iter)
+  {
+    Subscriber& Current = *Iter->second;
+
+    if ((int)Current.Queue.size() >= MaxQueuedFrames)
+    {
+      Current.Queue.pop_front();
+      Current.FramesDropped++;
+    }
+    Current.Queue.push_back(Frame);
+    if (!Current.WaitingWritable && !FlushSubscriber(Current))
+      FailedSockets.push_back(Iter->first);
+  }
+  for (size_t i = 0; i < FailedSockets.size(); ++i)
+    CloseSubscriber(FailedSockets[i]);
+}
+
+
+bool BroadcastServer::FlushSubscriber(Subscriber& subscriber)
+{
+  while (true)
+  {
+    if (subscriber.Current.isEmpty())
+    {
+      if (subscriber.Queue.empty())
+        break;
+
+      const quint32 Size = (quint32)subscriber.Queue.front().size();
+
+      subscriber.Current = subscriber.Queue.front();
+      subscriber.Queue.pop_front();
+      subscriber.Offset = 0;
+      subscriber.Header[0] = (char)((Size >> 24) & 0xFF);
+      subscriber.Header[1] = (char)((Size >> 16) & 0xFF);
+      subscriber.Header[2] = (char)((Size >> 8) & 0xFF);
+      subscriber.Header[3] = (char)(Size & 0xFF);
+    }
+    iovec Buffers[2];
+    msghdr Message;
+    int BufferCount = 0;
+
+    // Send the rest of the header and the data in one call
+    if (subscriber.Offset < HeaderSize)
+    {
+      Buffers[BufferCount].iov_base = subscriber.Header+subscriber.Offset;
+      Buffers[BufferCount].iov_len = HeaderSize-subscriber.Offset;
+      BufferCount++;
+    }
+    const int DataOffset = std::max(subscriber.Offset-HeaderSize, 0);
+
+    Buffers[BufferCount].iov_base = (void*)(subscriber.Current.constData()+DataOffset);
+    Buffers[BufferCount].iov_len = subscriber.Current.size()-DataOffset;
+    BufferCount++;
+    memset(&Message, 0, sizeof(Message));
+    Message.msg_iov = Buffers;
+    Message.msg_iovlen = BufferCount;
+
+    const ssize_t Result = sendmsg(subscriber.Socket, &Message, MSG_NOSIGNAL | MSG_DONTWAIT);
+
+    if (Result < 0)
+    {
+      if (errno != EAGAIN && errno != EWOULDBLOCK)
+        return false;
+
+      // Continue when the socket buffer drains
+      SetWritableInterest(subscriber, true);
+      return true;
+    }
+    subscriber.Offset += (int)Result;
+    subscriber.BytesSent += Result;
+    if (subscriber.Offset >= HeaderSize+subscriber.Current.size())
+    {
+      subscriber.Current = QByteArray();
+      subscriber.FramesSent++;
+    }
+  }
+  SetWritableInterest(subscriber, false);
+  return true;
+}
+
+
+void BroadcastServer::SetWritableInterest(Subscriber& subscriber, bool enable)
+{
+  if (subscriber.WaitingWritable == enable)
+    return;
+
+  epoll_event Event;
+
+  memset(&Event, 0, sizeof(Event));
+  Event.events = enable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+  Event.data.fd = subscriber.Socket;
+  epoll_ctl(EpollDescriptor, EPOLL_CTL_MOD, subscriber.Socket, &Event);
+  subscriber.WaitingWritable = enable;
+}
+
+
+void BroadcastServer::CloseSubscriber(int socket)
+{
+  SubscriberMap::iterator Iter = Subscribers.find(socket);
+
+  if (Iter == Subscribers.end())
+    return;
+
+  MC_LOG("Broadcast subscriber disconnected: %s (%d frames sent, %d dropped)", Iter->second->Address.c_str(),
+         Iter->second->FramesSent, Iter->second->FramesDropped);
+  epoll_ctl(EpollDescriptor, EPOLL_CTL_DEL, socket, NULL);
+  close(socket);
+  Subscribers.erase(Iter);
+  SubscriberCount.store((int)Subscribers.size());
+}
+
+
+void BroadcastServer::Wake()
+{
+  const uint64_t Counter = 1;
+
+  if (write(WakeDescriptor, &Counter, sizeof(Counter)) < 0 && errno != EAGAIN)
+    MC_LOG("Broadcast server cannot be woken up: %s", strerror(errno));
+}
+
+
+void BroadcastServer::ReportStatistics()
+{
+  for (SubscriberMap::const_iterator Iter = Subscribers.begin(); Iter != Subscribers.end(); ++Iter)
+  {
+    const Subscriber& Current = *Iter->second;
+
+    MC_LOG("Broadcast subscriber %s: %lld bytes sent, %d frames sent, %d frames dropped, %d frames queued",
+           Current.Address.c_str(), (long long)Current.BytesSent, Current.FramesSent, Current.FramesDropped,
+           (int)Current.Queue.size());
+  }
+}
@@ -0,0 +1,108 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef BroadcastServer_hpp
+#define BroadcastServer_hpp
+
+#include "FrameHandle.hpp"
+#include "FrameMailbox.hpp"
+
+#include <qatomic.h>
+#include <qbytearray.h>
+#include <qelapsedtimer.h>
+#include <qmutex.h>
+#include <qthread.h>
+
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <deque>
+#include <map>
+#include <string>
+
+class EncodedFrameCache;
+class ImageEncoder;
+
+/**
+ * Fans out the encoded frames to any number of subscribers on an epoll event loop.
+ *
+ * The frames are encoded once by the encoder thread of the server (through the shared
+ * frame cache) and sent with the length-prefixed framing of the wall pi stream. Every
+ * subscriber has its own queue with non-blocking writes, the oldest queued frame of a
+ * slow subscriber is dropped, so it can not stall the others.
+ */
+class BroadcastServer : public QThread
+{
+  Q_OBJECT
+public:
+  BroadcastServer(int port, EncodedFrameCache& cache, int bytes_per_second);
+  virtual ~BroadcastServer();
+
+  bool IsListening() const;
+  void SendFrame(const FrameHandle& frame);
+
+public Q_SLOTS:
+  void Publish(const QByteArray& data, qint64 encode_start);
+
+protected:
+  virtual void run();
+
+private:
+  struct Subscriber
+  {
+    int Socket;
+    std::string Address;
+    std::deque<QByteArray> Queue;
+    QByteArray Current;
+    char Header[4];
+    int Offset;
+    bool WaitingWritable;
+    qint64 BytesSent;
+    int FramesSent;
+    int FramesDropped;
+  };
+  typedef boost::shared_ptr<Subscriber> SubscriberSPtr;
+  typedef std::map<int, SubscriberSPtr> SubscriberMap;
+
+  void AcceptSubscribers();
+  void DistributeFrame();
+  bool FlushSubscriber(Subscriber& subscriber);
+  void SetWritableInterest(Subscriber& subscriber, bool enable);
+  void CloseSubscriber(int socket);
+  void Wake();
+  void ReportStatistics();
+
+  const int Port;
+  int ListenSocket;
+  int EpollDescriptor;
+  int WakeDescriptor;
+  QAtomicInt Stopping;
+  QAtomicInt SubscriberCount;
+  SubscriberMap Subscribers;
+  QByteArray PendingFrame;
+  QMutex PendingMutex;
+  QElapsedTimer Clock;
+  QElapsedTimer StatisticsTimer;
+  FrameMailbox Mailbox;
+  boost::scoped_ptr<ImageEncoder> Encoder;
+};
+
+#endif
@@ -0,0 +1,120 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "BroadcastSubscriber.hpp"
+
+#include <MCLog.hpp>
+
+#include <qelapsedtimer.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace
+{
+// Period of the report (ms)
+const int ReportInterval = 5000;
+}
+
+BroadcastSubscriber::BroadcastSubscriber(const QString& host_name, int port, int frame_delay) : HostName(host_name),
+  Port(port), FrameDelay(frame_delay)
+{
+}
+
+
+bool BroadcastSubscriber::Run()
+{
+  const int Socket = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in Address;
+
+  memset(&Address, 0, sizeof(Address));
+  Address.sin_family = AF_INET;
+  Address.sin_port = htons(Port);
+  if (Socket < 0 || inet_pton(AF_INET, HostName.toStdString().c_str(), &Address.sin_addr) != 1 ||
+      connect(Socket, (sockaddr*)&Address, sizeof(Address)) != 0)
+  {
+    MC_LOG("Cannot connect to the broadcast server %s:%d: %s", HostName.toStdString().c_str(), Port, strerror(errno));
+    if (Socket >= 0)
+      close(Socket);
+    return false;
+  }
+  QElapsedTimer ReportTimer;
+  unsigned char Header[4];
+  int FrameCount = 0;
+  long long ByteCount = 0;
+
+  MC_LOG("Subscribed to %s:%d (delay: %d ms/frame)", HostName.toStdString().c_str(), Port, FrameDelay);
+  ReportTimer.start();
+  while (ReadFully(Socket, (char*)Header, sizeof(Header)))
+  {
+    const int Size = (Header[0] << 24) | (Header[1] << 16) | (Header[2] << 8) | Header[3];
+
+    if (Size <= 0)
+      break;
+
+    FrameData.resize(Size);
+    if (!ReadFully(Socket, &FrameData[0], Size))
+      break;
+
+    FrameCount++;
+    ByteCount += Size+sizeof(Header);
+    // Simulate a slow subscriber
+    if (FrameDelay > 0)
+      MCSleep(FrameDelay);
+    if (ReportTimer.elapsed() >= ReportInterval)
+    {
+      const float Seconds = (float)ReportTimer.elapsed() / 1000;
+
+      MC_LOG("Subscriber: %1.2f fps, %1.0f bytes/s, last frame: %d bytes", FrameCount / Seconds, ByteCount / Seconds,
+             Size);
+      FrameCount = 0;
+      ByteCount = 0;
+      ReportTimer.start();
+    }
+  }
+  MC_LOG("Broadcast server closed the connection");
+  close(Socket);
+  return true;
+}
+
+
+bool BroadcastSubscriber::ReadFully(int socket, char* data, int size)
+{
+  int Received = 0;
+
+  while (Received < size)
+  {
+    const ssize_t Result = recv(socket, data+Received, size-Received, 0);
+
+    if (Result < 0 && errno == EINTR)
+      continue;
+
+    if (Result <= 0)
+      return false;
+
+    Received += (int)Result;
+  }
+  return true;
+}
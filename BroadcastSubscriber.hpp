@@ -0,0 +1,51 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef BroadcastSubscriber_hpp
+#define BroadcastSubscriber_hpp
+
+#include <qstring.h>
+
+#include <vector>
+
+/**
+ * Test subscriber of the broadcast server.
+ *
+ * It reads the length-prefixed frames and reports the frame rate and the
+ * throughput. A delay after every frame simulates a slow subscriber.
+ */
+class BroadcastSubscriber
+{
+public:
+  BroadcastSubscriber(const QString& host_name, int port, int frame_delay);
+
+  bool Run();
+
+protected:
+  bool ReadFully(int socket, char* data, int size);
+
+  const QString HostName;
+  const int Port;
+  const int FrameDelay;
+  std::vector<char> FrameData;
+};
+
+#endif
@@ -0,0 +1,155 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "CalibrationCache.hpp"
+
+#include <MCLog.hpp>
+
+#include <qdatastream.h>
+#include <qfile.h>
+#include <qsavefile.h>
+
+namespace
+{
+const quint32 CacheMagic = 0x494f5043;
+const quint32 CacheVersion = 1;
+
+void WritePoint(QDataStream& stream, const MEPoint& point)
+{
+  stream << (qint32)point.X << (qint32)point.Y;
+}
+
+
+MEPoint ReadPoint(QDataStream& stream)
+{
+  qint32 X = -1;
+  qint32 Y = -1;
+
+  stream >> X >> Y;
+  return MEPoint(X, Y);
+}
+}
+
+bool CalibrationCache::Load(const QString& file_name, CalibrationData& data)
+{
+  QFile File(file_name);
+
+  if (!File.open(QIODevice::ReadOnly))
+    return false;
+
+  QDataStream Stream(&File);
+  quint32 Magic = 0;
+  quint32 Version = 0;
+  qint32 Width = 0;
+  qint32 Height = 0;
+  qint32 Rows = 0;
+  qint32 Count = 0;
+  qint32 Locked = 0;
+
+  Stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+  Stream >> Magic >> Version;
+  if (Magic != CacheMagic || Version != CacheVersion)
+  {
+    MC_LOG("Unknown calibration cache format in %s", qPrintable(file_name));
+    return false;
+  }
+  Stream >> Width >> Height;
+  data.FrameWidth = Width;
+  data.FrameHeight = Height;
+  // Intrinsics
+  Stream >> Rows;
+  if (Rows < 0 || Rows > 3)
+    return false;
+
+  data.Intrinsics.clear();
+  data.Intrinsics.resize(Rows);
+  for (int i = 0; i < Rows; ++i)
+  {
+    Stream >> Count;
+    if (Count < 0 || Count > 3)
+      return false;
+
+    data.Intrinsics[i].resize(Count);
+    for (int j = 0; j < Count; ++j)
+      Stream >> data.Intrinsics[i][j];
+  }
+  // Distortion coefficients
+  Stream >> Count;
+  if (Count < 0 || Count > 8)
+    return false;
+
+  data.DistortionCoefficients.resize(Count);
+  for (int i = 0; i < Count; ++i)
+    Stream >> data.DistortionCoefficients[i];
+  // Rotation and table corners
+  Stream >> data.RotationAngle;
+  data.RotationCenter = ReadPoint(Stream);
+  Stream >> Locked;
+  data.Markers.Locked = Locked != 0;
+  for (int i = 0; i < 4; ++i)
+  {
+    data.Markers.Corners[i] = ReadPoint(Stream);
+    data.Markers.References[i] = ReadPoint(Stream);
+  }
+  return Stream.status() == QDataStream::Ok;
+}
+
+
+bool CalibrationCache::Save(const QString& file_name, const CalibrationData& data)
+{
+  // The file is written aside and renamed over the target on commit, a truncated cache is never left behind
+  QSaveFile File(file_name);
+
+  if (!File.open(QIODevice::WriteOnly))
+  {
+    MC_LOG("Unable to write the calibration cache to %s", qPrintable(file_name));
+    return false;
+  }
+  QDataStream Stream(&File);
+
+  Stream.setFloatingPointPrecision(QDataStream::SinglePrecision);
+  Stream << CacheMagic << CacheVersion;
+  Stream << (qint32)data.FrameWidth << (qint32)data.FrameHeight;
+  Stream << (qint32)data.Intrinsics.size();
+  for (unsigned int i = 0; i < data.Intrinsics.size(); ++i)
+  {
+    Stream << (qint32)data.Intrinsics[i].size();
+    for (unsigned int j = 0; j < data.Intrinsics[i].size(); ++j)
+      Stream << data.Intrinsics[i][j];
+  }
+  Stream << (qint32)data.DistortionCoefficients.size();
+  for (unsigned int i = 0; i < data.DistortionCoefficients.size(); ++i)
+    Stream << data.DistortionCoefficients[i];
+  Stream << data.RotationAngle;
+  WritePoint(Stream, data.RotationCenter);
+  Stream << (qint32)(data.Markers.Locked ? 1 : 0);
+  for (int i = 0; i < 4; ++i)
+  {
+    WritePoint(Stream, data.Markers.Corners[i]);
+    WritePoint(Stream, data.Markers.References[i]);
+  }
+  if (Stream.status() != QDataStream::Ok)
+  {
+    File.cancelWriting();
+    return false;
+  }
+  return File.commit();
+}
@@ -0,0 +1,58 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef CalibrationCache_hpp
+#define CalibrationCache_hpp
+
+#include "TableMarkers.hpp"
+
+#include <MCDefs.hpp>
+
+#include <qstring.h>
+
+/**
+ * Camera state which is stored on disk after a successful table lock.
+ *
+ * The intrinsics and the distortion coefficients are stored as plain values
+ * because the serialized MECalibration archive is not portable between the
+ * machines. They only identify the calibration the rotation and the corners
+ * were measured with, a cache of a different calibration is not used.
+ */
+struct CalibrationData
+{
+  CalibrationData() : FrameWidth(0), FrameHeight(0), RotationAngle(0) {}
+
+  int FrameWidth;
+  int FrameHeight;
+  MC::FloatTable Intrinsics;
+  MC::FloatList DistortionCoefficients;
+  float RotationAngle;
+  MEPoint RotationCenter;
+  TableMarkers::Snapshot Markers;
+};
+
+namespace CalibrationCache
+{
+bool Load(const QString& file_name, CalibrationData& data);
+bool Save(const QString& file_name, const CalibrationData& data);
+}
+
+#endif
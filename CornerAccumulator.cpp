@@ -0,0 +1,246 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "CornerAccumulator.hpp"
+
+#include <MCDefs.hpp>
+
+#include <algorithm>
+#include <stdlib.h>
+
+CornerAccumulator::CornerAccumulator(int sample_count, bool reject_outliers) :
+  SampleCount(MCBound(1, sample_count, (int)MaxSampleCount)), RejectOutliers(reject_outliers),
+  MinRejectionSampleCount(10), MinDeviation(3), RecoverySampleCount(10)
+{
+  Reset();
+}
+
+
+void CornerAccumulator::Reset()
+{
+  for (int i = 0; i < CornerCount; ++i)
+    Reset(i);
+}
+
+
+void CornerAccumulator::Reset(int corner)
+{
+  SumX[corner] = 0;
+  SumY[corner] = 0;
+  Counts[corner] = 0;
+  Heads[corner] = 0;
+  RejectedSumX[corner] = 0;
+  RejectedSumY[corner] = 0;
+  RejectedCounts[corner] = 0;
+  AcceptedSinceRejection[corner] = 0;
+}
+
+
+bool CornerAccumulator::AddSample(int corner, int x, int y)
+{
+  if (RejectOutliers && IsOutlier(corner, x, y))
+  {
+    if (!AddRejected(corner, x, y))
+      return false;
+
+    // The rejected samples agree with each other: restart the window from them
+    const int Count = std::min(RejectedCounts[corner], SampleCount);
+    int ClusterX[MaxSampleCount];
+    int ClusterY[MaxSampleCount];
+
+    std::copy(RejectedX[corner], RejectedX[corner]+Count, ClusterX);
+    std::copy(RejectedY[corner], RejectedY[corner]+Count, ClusterY);
+    Reset(corner);
+    for (int i = 0; i < Count; ++i)
+      Append(corner, ClusterX[i], ClusterY[i]);
+    return true;
+  }
+  // Sporadic rejections between the accepted samples are real outliers
+  if (RejectedCounts[corner] > 0 && ++AcceptedSinceRejection[corner] > 2*RecoverySampleCount)
+  {
+    RejectedSumX[corner] = 0;
+    RejectedSumY[corner] = 0;
+    RejectedCounts[corner] = 0;
+    AcceptedSinceRejection[corner] = 0;
+  }
+  Append(corner, x, y);
+  return true;
+}
+
+
+void CornerAccumulator::Fill(int corner, int x, int y)
+{
+  Reset(corner);
+  std::fill(SamplesX[corner], SamplesX[corner]+SampleCount, x);
+  std::fill(SamplesY[corner], SamplesY[corner]+SampleCount, y);
+  std::fill(SortedX[corner], SortedX[corner]+SampleCount, x);
+  std::fill(SortedY[corner], SortedY[corner]+SampleCount, y);
+  SumX[corner] = x*SampleCount;
+  SumY[corner] = y*SampleCount;
+  Counts[corner] = SampleCount;
+}
+
+
+bool CornerAccumulator::IsValid(int corner) const
+{
+  return Counts[corner] == SampleCount;
+}
+
+
+bool CornerAccumulator::AreAllValid() const
+{
+  for (int i = 0; i < CornerCount; ++i)
+  {
+    if (!IsValid(i))
+      return false;
+  }
+  return true;
+}
+
+
+int CornerAccumulator::GetMissingSampleCount(int corner) const
+{
+  return SampleCount-Counts[corner];
+}
+
+
+MEPoint CornerAccumulator::GetMean(int corner) const
+{
+  if (Counts[corner] == 0)
+    return MEPoint(-1, -1);
+
+  return MEPoint(SumX[corner] / Counts[corner], SumY[corner] / Counts[corner]);
+}
+
+
+bool CornerAccumulator::IsOutlier(int corner, int x, int y) const
+{
+  const int Count = Counts[corner];
+
+  if (Count < MinRejectionSampleCount)
+    return false;
+
+  // Median and median absolute deviation of both coordinates
+  const int* Coordinates[2] = { SortedX[corner], SortedY[corner] };
+  const int Values[2] = { x, y };
+
+  for (int c = 0; c < 2; ++c)
+  {
+    const int Median = Coordinates[c][Count / 2];
+    // 1.4826 * MAD estimates the standard deviation
+    const float Deviation = std::max((float)MinDeviation,
+                                     1.4826f*GetMedianDeviation(Coordinates[c], Count));
+
+    if (abs(Values[c]-Median) > 3*Deviation)
+      return true;
+  }
+  return false;
+}
+
+
+bool CornerAccumulator::AddRejected(int corner, int x, int y)
+{
+  int& Count = RejectedCounts[corner];
+
+  // A rejected sample far from the current cluster starts a new one
+  if (Count > 0 &&
+      (abs(x-RejectedSumX[corner] / Count) > 2*MinDeviation ||
+       abs(y-RejectedSumY[corner] / Count) > 2*MinDeviation))
+  {
+    RejectedSumX[corner] = 0;
+    RejectedSumY[corner] = 0;
+    Count = 0;
+  }
+  if (Count == 0)
+    AcceptedSinceRejection[corner] = 0;
+
+  RejectedX[corner][Count] = x;
+  RejectedY[corner][Count] = y;
+  RejectedSumX[corner] += x;
+  RejectedSumY[corner] += y;
+  Count++;
+  return Count >= RecoverySampleCount;
+}
+
+
+void CornerAccumulator::Append(int corner, int x, int y)
+{
+  int& Head = Heads[corner];
+
+  // Replace the oldest sample when the window is full
+  if (Counts[corner] == SampleCount)
+  {
+    SumX[corner] -= SamplesX[corner][Head];
+    SumY[corner] -= SamplesY[corner][Head];
+    RemoveSorted(SortedX[corner], Counts[corner], SamplesX[corner][Head]);
+    RemoveSorted(SortedY[corner], Counts[corner], SamplesY[corner][Head]);
+    Counts[corner]--;
+  }
+  InsertSorted(SortedX[corner], Counts[corner], x);
+  InsertSorted(SortedY[corner], Counts[corner], y);
+  Counts[corner]++;
+  SamplesX[corner][Head] = x;
+  SamplesY[corner][Head] = y;
+  SumX[corner] += x;
+  SumY[corner] += y;
+  Head = (Head+1) % SampleCount;
+}
+
+
+void CornerAccumulator::InsertSorted(int* values, int count, int value)
+{
+  int* Position = std::upper_bound(values, values+count, value);
+
+  std::copy_backward(Position, values+count, values+count+1);
+  *Position = value;
+}
+
+
+void CornerAccumulator::RemoveSorted(int* values, int count, int value)
+{
+  int* Position = std::lower_bound(values, values+count, value);
+
+  std::copy(Position+1, values+count, Position);
+}
+
+
+int CornerAccumulator::GetMedianDeviation(const int* values, int count)
+{
+  // The deviations grow from the median in both directions of the sorted
+  // window, so the median of them is found by merging the two sides
+  const int Median = values[count / 2];
+  int Lower = count / 2-1;
+  int Upper = count / 2;
+  int Deviation = 0;
+
+  for (int i = 0; i <= count / 2; ++i)
+  {
+    if (Lower >= 0 && (Upper >= count || Median-values[Lower] <= values[Upper]-Median))
+    {
+      Deviation = Median-values[Lower];
+      Lower--;
+    } else {
+      Deviation = values[Upper]-Median;
+      Upper++;
+    }
+  }
+  return Deviation;
+}
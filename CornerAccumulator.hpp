@@ -0,0 +1,92 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef CornerAccumulator_hpp
+#define CornerAccumulator_hpp
+
+#include <MEDefs.hpp>
+
+/**
+ * Sliding window statistics of the four table corners.
+ *
+ * The samples are kept in fixed arrays per coordinate, the mean is maintained
+ * with running sums. A corner is valid when its window is full. The optional
+ * outlier rejection drops the samples that are further from the window median
+ * than three times the scaled median absolute deviation. The window is also
+ * kept sorted per coordinate, so the median and the MAD are read without
+ * copying or sorting the samples.
+ *
+ * The rejection is bounded: when the rejected samples of a corner form a
+ * consistent cluster, the window was seeded on a wrong blob and it restarts
+ * from the cluster. The restarted window holds only the cluster samples, the
+ * caller can follow the refill with GetMissingSampleCount().
+ */
+class CornerAccumulator
+{
+public:
+  enum
+  {
+    CornerCount = 4,
+    MaxSampleCount = 64,
+  };
+
+  CornerAccumulator(int sample_count, bool reject_outliers);
+
+  void Reset();
+  void Reset(int corner);
+  bool AddSample(int corner, int x, int y);
+  void Fill(int corner, int x, int y);
+  bool IsValid(int corner) const;
+  bool AreAllValid() const;
+  int GetMissingSampleCount(int corner) const;
+  MEPoint GetMean(int corner) const;
+
+private:
+  bool IsOutlier(int corner, int x, int y) const;
+  bool AddRejected(int corner, int x, int y);
+  void Append(int corner, int x, int y);
+  static void InsertSorted(int* values, int count, int value);
+  static void RemoveSorted(int* values, int count, int value);
+  static int GetMedianDeviation(const int* values, int count);
+
+protected:
+  const int SampleCount;
+  const bool RejectOutliers;
+  const int MinRejectionSampleCount;
+  const int MinDeviation;
+  const int RecoverySampleCount;
+  int SamplesX[CornerCount][MaxSampleCount];
+  int SamplesY[CornerCount][MaxSampleCount];
+  int SumX[CornerCount];
+  int SumY[CornerCount];
+  int Counts[CornerCount];
+  int Heads[CornerCount];
+  int SortedX[CornerCount][MaxSampleCount];
+  int SortedY[CornerCount][MaxSampleCount];
+  int RejectedX[CornerCount][MaxSampleCount];
+  int RejectedY[CornerCount][MaxSampleCount];
+  int RejectedSumX[CornerCount];
+  int RejectedSumY[CornerCount];
+  int RejectedCounts[CornerCount];
+  int AcceptedSinceRejection[CornerCount];
+};
+
+#endif
@@ -0,0 +1,221 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "CornerBenchmark.hpp"
+
+#include "CornerFinder.hpp"
+#include "FrameAnalyzer.hpp"
+#include "TableMarkers.hpp"
+
+#include <MECapture.hpp>
+#include <MEImage.hpp>
+
+#include <MCLog.hpp>
+
+#include <qelapsedtimer.h>
+
+#include <opencv/cv.h>
+
+namespace
+{
+// Size of the analysed frames
+const int FrameWidth = 320;
+const int FrameHeight = 180;
+// Repetitions of the projection step on every region
+const int ProjectionRepeats = 20;
+}
+
+CornerBenchmark::CornerBenchmark(const QString& video_file, int frame_count) : VideoFile(video_file),
+  FrameCount(frame_count)
+{
+}
+
+
+bool CornerBenchmark::Run()
+{
+  MECapture CaptureDevice;
+  MEImage CapturedImage;
+  MEImage Frame;
+  MEImage RegionImage;
+  CornerFinder Finder(false);
+  TableMarkers Markers(FrameWidth, FrameHeight, false);
+  QElapsedTimer Timer;
+  long long PerRegionTime = 0;
+  long long FinderTime = 0;
+  long long PerAxisProjectionTime = 0;
+  long long SinglePassProjectionTime = 0;
+  int Frames = 0;
+  int Mismatches = 0;
+
+  CaptureDevice.Start(VideoFile.toStdString());
+  CaptureDevice.SetPlaybackFPS(1000);
+  while (Frames < FrameCount && CaptureDevice.IsCapturing() && CaptureDevice.CaptureFrame(CapturedImage))
+  {
+    // The corner search gets the same luma plane as in the frame analysis
+    FrameAnalyzer::ConvertToLuma(CapturedImage, FrameWidth, FrameHeight, Frame);
+    for (int i = 0; i < 4; ++i)
+    {
+      int X1, Y1, X2, Y2;
+
+      Markers.GetSearchRegion(i, X1, Y1, X2, Y2);
+      Timer.start();
+      const MEPoint PerRegionPoint = FindCornerPerRegion(Frame, X1, Y1, X2, Y2);
+
+      PerRegionTime += Timer.nsecsElapsed();
+      Timer.start();
+      // The image is taken once per frame
+      if (i == 0)
+        Finder.SetImage(Frame);
+      const MEPoint FinderPoint = Finder.FindCorner(X1, Y1, X2, Y2);
+
+      FinderTime += Timer.nsecsElapsed();
+      if (PerRegionPoint.X != FinderPoint.X || PerRegionPoint.Y != FinderPoint.Y)
+        Mismatches++;
+      // Time only the projections on the same binarized region
+      Frame.CopyImagePart(X1, Y1, X2, Y2, RegionImage);
+      RegionImage.AdaptiveThreshold();
+      RegionImage.Binarize(1);
+
+      const unsigned char* Data = (const unsigned char*)RegionImage.GetIplImage()->imageData;
+      const int Width = RegionImage.GetWidth();
+      const int Height = RegionImage.GetHeight();
+
+      RowCounts.resize(Height);
+      ColumnCounts.resize(Width);
+      Timer.start();
+      for (int r = 0; r < ProjectionRepeats; ++r)
+        CalculateProjectionsPerAxis(Data, Width, Height, RegionImage.GetRowWidth(), &RowCounts[0], &ColumnCounts[0]);
+      PerAxisProjectionTime += Timer.nsecsElapsed();
+      Timer.start();
+      for (int r = 0; r < ProjectionRepeats; ++r)
+        CornerFinder::CalculateProjections(Data, Width, Height, RegionImage.GetRowWidth(), &RowCounts[0],
+                                           &ColumnCounts[0]);
+      SinglePassProjectionTime += Timer.nsecsElapsed();
+    }
+    Frames++;
+  }
+  if (Frames == 0)
+  {
+    MC_LOG("No frames in the video file: %s", qPrintable(VideoFile));
+    return false;
+  }
+  const float Repeats = (float)Frames*ProjectionRepeats;
+
+  MC_LOG("Corner search on %d frames (%d mismatching positions)", Frames, Mismatches);
+  MC_LOG("Per-region search: %1.3f ms/frame, corner finder: %1.3f ms/frame (%1.2fx)",
+         (float)PerRegionTime / 1000000 / Frames, (float)FinderTime / 1000000 / Frames,
+         FinderTime > 0 ? (float)PerRegionTime / FinderTime : 0);
+  MC_LOG("Projections of the four regions: %1.3f us per-axis, %1.3f us single pass (%1.2fx)",
+         (float)PerAxisProjectionTime / 1000 / Repeats, (float)SinglePassProjectionTime / 1000 / Repeats,
+         SinglePassProjectionTime > 0 ? (float)PerAxisProjectionTime / SinglePassProjectionTime : 0);
+  return true;
+}
+
+
+MEPoint CornerBenchmark::FindCornerPerRegion(const MEImage& image, int x1, int y1, int x2, int y2)
+{
+  const int X1 = MCBound(0, x1, image.GetWidth()-1);
+  const int Y1 = MCBound(0, y1, image.GetHeight()-1);
+  const int X2 = MCBound(0, x2, image.GetWidth()-1);
+  const int Y2 = MCBound(0, y2, image.GetHeight()-1);
+
+  if (X2-X1 <= 0 || Y2-Y1 <= 0)
+    return MEPoint(-1, -1);
+
+  // The original search: a new grayscale copy of every region
+  MEImage RegionImage;
+
+  image.CopyImagePart(X1, Y1, X2, Y2, RegionImage);
+  if (RegionImage.GetLayers() != 1)
+    RegionImage.ConvertToGrayscale();
+  if (RegionImage.AverageBrightnessLevel() > 110)
+    return MEPoint(-1, -1);
+
+  RegionImage.AdaptiveThreshold();
+  RegionImage.Binarize(1);
+
+  const int Width = RegionImage.GetWidth();
+  const int Height = RegionImage.GetHeight();
+
+  RowCounts.resize(Height);
+  ColumnCounts.resize(Width);
+  CalculateProjectionsPerAxis((const unsigned char*)RegionImage.GetIplImage()->imageData, Width, Height,
+                              RegionImage.GetRowWidth(), &RowCounts[0], &ColumnCounts[0]);
+
+  int FirstX = -1;
+  int FirstY = -1;
+  int SumX = 0;
+  int SumY = 0;
+  int CountX = 0;
+  int CountY = 0;
+
+  for (int y = 0; y < Height; ++y)
+  {
+    if (RowCounts[y] > 10)
+    {
+      if (CountY == 0)
+        FirstY = y;
+      SumY += y;
+      CountY++;
+    }
+  }
+  for (int x = 0; x < Width; ++x)
+  {
+    if (ColumnCounts[x] > 10)
+    {
+      if (CountX == 0)
+        FirstX = x;
+      SumX += x;
+      CountX++;
+    }
+  }
+  if (CountX == 0 || CountY == 0)
+    return MEPoint(-1, -1);
+
+  if (CountX == 1 || CountY == 1)
+    return MEPoint(FirstX, FirstY);
+
+  return MEPoint(x1+SumX / CountX, y1+SumY / CountY);
+}
+
+
+void CornerBenchmark::CalculateProjectionsPerAxis(const unsigned char* data, int width, int height, int row_width,
+                                                  unsigned short* row_counts, unsigned short* column_counts)
+{
+  // Rows in one pass, the columns in an other pass with a stride of a row
+  for (int y = 0; y < height; ++y)
+  {
+    const unsigned char* Row = data+y*row_width;
+    int Count = 0;
+
+    for (int x = 0; x < width; ++x)
+      Count += Row[x] > 0;
+    row_counts[y] = Count;
+  }
+  for (int x = 0; x < width; ++x)
+  {
+    int Count = 0;
+
+    for (int y = 0; y < height; ++y)
+      Count += data[y*row_width+x] > 0;
+    column_counts[x] = Count;
+  }
+}
@@ -0,0 +1,59 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef CornerBenchmark_hpp
+#define CornerBenchmark_hpp
+
+#include <MEDefs.hpp>
+
+#include <qstring.h>
+
+#include <vector>
+
+class MEImage;
+
+/**
+ * Benchmark of the table corner search on the frames of a video file.
+ *
+ * The frames are searched with the original per-region path (a grayscale copy of
+ * every region and two projection passes) and with CornerFinder, the positions are
+ * compared. The projection step is timed separately on the same binarized regions
+ * to show the gain of the single vectorized pass.
+ */
+class CornerBenchmark
+{
+public:
+  CornerBenchmark(const QString& video_file, int frame_count);
+
+  bool Run();
+
+protected:
+  MEPoint FindCornerPerRegion(const MEImage& image, int x1, int y1, int x2, int y2);
+  static void CalculateProjectionsPerAxis(const unsigned char* data, int width, int height, int row_width,
+                                          unsigned short* row_counts, unsigned short* column_counts);
+
+  const QString VideoFile;
+  const int FrameCount;
+  std::vector<unsigned short> RowCounts;
+  std::vector<unsigned short> ColumnCounts;
+};
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "CornerFinder.hpp"
+
+#include <MEImage.hpp>
+
+#include <opencv/cv.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+CornerFinder::CornerFinder(bool logging) : Logging(logging), GrayImage(new MEImage), RegionImage(new MEImage)
+{
+}
+
+
+CornerFinder::~CornerFinder()
+{
+}
+
+
+void CornerFinder::SetImage(const MEImage& image)
+{
+  *GrayImage = image;
+  if (GrayImage->GetLayers() != 1)
+    GrayImage->ConvertToGrayscale();
+}
+
+
+MEPoint CornerFinder::FindCorner(int x1, int y1, int x2, int y2, bool image_coordinates)
+{
+  const int X1 = MCBound(0, x1, GrayImage->GetWidth()-1);
+  const int Y1 = MCBound(0, y1, GrayImage->GetHeight()-1);
+  const int X2 = MCBound(0, x2, GrayImage->GetWidth()-1);
+  const int Y2 = MCBound(0, y2, GrayImage->GetHeight()-1);
+
+  if (X2-X1 <= 0 || Y2-Y1 <= 0)
+    return MEPoint(-1, -1);
+
+  // Copy the search region
+  float Brightness = 0;
+  const float BrightnessLimit = 110;
+
+  GrayImage->CopyImagePart(X1, Y1, X2, Y2, *RegionImage);
+  Brightness = RegionImage->AverageBrightnessLevel();
+  if (Brightness > BrightnessLimit)
+  {
+    if (Logging)
+      printf("Region (%dx%d-%dx%d) is too bright (%1.2f > %1.0f)\n", x1, y1, x2, y2, Brightness, BrightnessLimit);
+    return MEPoint(-1, -1);
+  }
+  RegionImage->AdaptiveThreshold();
+  RegionImage->Binarize(1);
+
+  const int Width = RegionImage->GetWidth();
+  const int Height = RegionImage->GetHeight();
+
+  if ((int)RowCounts.size() < Height)
+    RowCounts.resize(Height);
+  if ((int)ColumnCounts.size() < Width)
+    ColumnCounts.resize(Width);
+
+  CalculateProjections((const unsigned char*)RegionImage->GetIplImage()->imageData, Width, Height,
+                       RegionImage->GetRowWidth(), &RowCounts[0], &ColumnCounts[0]);
+
+  // Rows and columns with more than 10 white pixels are the marker positions
+  int FirstX = -1;
+  int FirstY = -1;
+  int SumX = 0;
+  int SumY = 0;
+  int CountX = 0;
+  int CountY = 0;
+
+  for (int y = 0; y < Height; ++y)
+  {
+    if (RowCounts[y] > 10)
+    {
+      if (CountY == 0)
+        FirstY = y;
+      SumY += y;
+      CountY++;
+    }
+  }
+  for (int x = 0; x < Width; ++x)
+  {
+    if (ColumnCounts[x] > 10)
+    {
+      if (CountX == 0)
+        FirstX = x;
+      SumX += x;
+      CountX++;
+    }
+  }
+  if (CountX == 0 || CountY == 0)
+    return MEPoint(-1, -1);
+
+  if (CountX == 1 || CountY == 1)
+    return image_coordinates ? MEPoint(X1+FirstX, Y1+FirstY) : MEPoint(FirstX, FirstY);
+
+  // The region starts at the clamped position when a tracking window leaves the image
+  return MEPoint(X1+SumX / CountX, Y1+SumY / CountY);
+}
+
+
+void CornerFinder::CalculateProjections(const unsigned char* data, int width, int height, int row_width,
+                                        unsigned short* row_counts, unsigned short* column_counts)
+{
+  memset(column_counts, 0, width*sizeof(unsigned short));
+  for (int y = 0; y < height; ++y)
+  {
+    const unsigned char* Row = data+y*row_width;
+    int RowCount = 0;
+    int x = 0;
+
+#if defined(__SSE2__)
+    const __m128i Zero = _mm_setzero_si128();
+    const __m128i One = _mm_set1_epi8(1);
+    __m128i RowSum = _mm_setzero_si128();
+
+    for (; x+16 <= width; x += 16)
+    {
+      // 1 for the white pixels, 0 otherwise
+      const __m128i White = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(Row+x)), Zero), One);
+      __m128i* Columns = (__m128i*)(column_counts+x);
+
+      _mm_storeu_si128(Columns, _mm_add_epi16(_mm_loadu_si128(Columns), _mm_unpacklo_epi8(White, Zero)));
+      _mm_storeu_si128(Columns+1, _mm_add_epi16(_mm_loadu_si128(Columns+1), _mm_unpackhi_epi8(White, Zero)));
+      RowSum = _mm_add_epi64(RowSum, _mm_sad_epu8(White, Zero));
+    }
+    RowCount = _mm_cvtsi128_si32(RowSum)+_mm_cvtsi128_si32(_mm_srli_si128(RowSum, 8));
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    uint32x4_t RowSum = vdupq_n_u32(0);
+
+    for (; x+16 <= width; x += 16)
+    {
+      const uint8x16_t Pixels = vld1q_u8(Row+x);
+      // 1 for the white pixels, 0 otherwise
+      const uint8x16_t White = vshrq_n_u8(vtstq_u8(Pixels, Pixels), 7);
+
+      vst1q_u16(column_counts+x, vaddw_u8(vld1q_u16(column_counts+x), vget_low_u8(White)));
+      vst1q_u16(column_counts+x+8, vaddw_u8(vld1q_u16(column_counts+x+8), vget_high_u8(White)));
+      RowSum = vpadalq_u16(RowSum, vpaddlq_u8(White));
+    }
+    RowCount = vgetq_lane_u32(RowSum, 0)+vgetq_lane_u32(RowSum, 1)+vgetq_lane_u32(RowSum, 2)+vgetq_lane_u32(RowSum, 3);
+#endif
+    for (; x < width; ++x)
+    {
+      const int White = Row[x] > 0;
+
+      column_counts[x] += White;
+      RowCount += White;
+    }
+    row_counts[y] = RowCount;
+  }
+}
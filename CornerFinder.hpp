@@ -0,0 +1,64 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef CornerFinder_hpp
+#define CornerFinder_hpp
+
+#include <MEDefs.hpp>
+
+#include <boost/scoped_ptr.hpp>
+
+#include <vector>
+
+class MEImage;
+
+/**
+ * Table corner search on a grayscale plane shared by the search regions.
+ *
+ * The grayscale conversion is done once per frame and the scratch buffers are kept
+ * between the frames. The white pixel projections of a region are calculated in one
+ * row-major pass.
+ *
+ * A single marker line gives a position relative to the region in the full corner
+ * search (as the original search did), the tracking asks for image coordinates.
+ * The too bright regions are reported only when the logging is enabled.
+ */
+class CornerFinder
+{
+public:
+  explicit CornerFinder(bool logging);
+  virtual ~CornerFinder();
+
+  void SetImage(const MEImage& image);
+  MEPoint FindCorner(int x1, int y1, int x2, int y2, bool image_coordinates = false);
+
+  static void CalculateProjections(const unsigned char* data, int width, int height, int row_width,
+                                   unsigned short* row_counts, unsigned short* column_counts);
+
+protected:
+  const bool Logging;
+  boost::scoped_ptr<MEImage> GrayImage;
+  boost::scoped_ptr<MEImage> RegionImage;
+  std::vector<unsigned short> RowCounts;
+  std::vector<unsigned short> ColumnCounts;
+};
+
+#endif
@@ -37,6 +37,8 @@ typedef enum
   IdleEvent,
   NormalEvent,
   MissingCornersEvent,
+  // A frame was captured, but not analysed
+  SkippedFrameEvent,
 } VideoEventType;
 }
 
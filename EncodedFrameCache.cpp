@@ -0,0 +1,115 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "EncodedFrameCache.hpp"
+
+#include "JpegEncoder.hpp"
+
+#include <QMutexLocker>
+
+EncodedFrameCache::EncodedFrameCache(int capacity) : Capacity(capacity), HitCount(0), MissCount(0)
+{
+}
+
+
+QByteArray EncodedFrameCache::GetJpeg(const FrameHandle& frame, int quality)
+{
+  if (frame.IsNull())
+    return QByteArray();
+
+  const MEImage* Image = &frame.GetImage();
+  QMutexLocker Lock(&Mutex);
+
+  for (EntryList::iterator Iter = Entries.begin(); Iter != Entries.end(); ++Iter)
+  {
+    if ((*Iter)->Sequence != frame.GetSequence() || (*Iter)->Image != Image || (*Iter)->Quality != quality)
+      continue;
+
+    // Keep the entry alive even if it is evicted while waiting
+    boost::shared_ptr<Entry> Found = *Iter;
+
+    HitCount++;
+    // An other consumer compresses the same frame right now
+    while (!Found->Ready)
+      EncodingFinished.wait(&Mutex);
+    return Found->Data;
+  }
+  MissCount++;
+  // Reserve the entry (the newest is at the front) and compress the frame without the lock
+  boost::shared_ptr<Entry> NewEntry(new Entry);
+
+  NewEntry->Sequence = frame.GetSequence();
+  NewEntry->Image = Image;
+  NewEntry->Quality = quality;
+  NewEntry->Ready = false;
+  Entries.push_front(NewEntry);
+  Evict();
+  // Every concurrent compression gets its own encoder, they are reused between the frames
+  boost::shared_ptr<JpegEncoder> Encoder;
+
+  if (IdleEncoders.empty())
+  {
+    Encoder.reset(new JpegEncoder);
+  } else {
+    Encoder = IdleEncoders.back();
+    IdleEncoders.pop_back();
+  }
+  Lock.unlock();
+  QByteArray Result;
+
+  Encoder->Encode(*Image, quality, Result);
+  Lock.relock();
+  IdleEncoders.push_back(Encoder);
+  NewEntry->Data = Result;
+  NewEntry->Ready = true;
+  EncodingFinished.wakeAll();
+  return Result;
+}
+
+
+int EncodedFrameCache::GetHitCount()
+{
+  QMutexLocker Lock(&Mutex);
+
+  return HitCount;
+}
+
+
+int EncodedFrameCache::GetMissCount()
+{
+  QMutexLocker Lock(&Mutex);
+
+  return MissCount;
+}
+
+
+void EncodedFrameCache::Evict()
+{
+  // Drop the oldest compressed frames, the entries in progress are kept
+  EntryList::iterator Iter = Entries.end();
+
+  while ((int)Entries.size() > Capacity && Iter != Entries.begin())
+  {
+    --Iter;
+    if ((*Iter)->Ready)
+      Iter = Entries.erase(Iter);
+  }
+}
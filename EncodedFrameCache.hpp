@@ -0,0 +1,78 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef EncodedFrameCache_hpp
+#define EncodedFrameCache_hpp
+
+#include "FrameHandle.hpp"
+
+#include <qbytearray.h>
+#include <qmutex.h>
+#include <qwaitcondition.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <list>
+#include <vector>
+
+class JpegEncoder;
+class MEImage;
+
+/**
+ * Cache of the compressed frames shared by the consumers of the image stream.
+ *
+ * A frame is identified by its sequence number and its pixel buffer (a detached copy
+ * with overlays has the same sequence), it is compressed to JPEG at most once per quality.
+ * The consumers get an implicitly shared QByteArray, the concurrent requests of the same
+ * frame wait for the first compression instead of encoding the frame again.
+ */
+class EncodedFrameCache
+{
+public:
+  EncodedFrameCache(int capacity);
+
+  QByteArray GetJpeg(const FrameHandle& frame, int quality);
+  int GetHitCount();
+  int GetMissCount();
+
+protected:
+  struct Entry
+  {
+    int Sequence;
+    const MEImage* Image;
+    int Quality;
+    bool Ready;
+    QByteArray Data;
+  };
+  typedef std::list<boost::shared_ptr<Entry> > EntryList;
+
+  void Evict();
+
+  const int Capacity;
+  EntryList Entries;
+  std::vector<boost::shared_ptr<JpegEncoder> > IdleEncoders;
+  int HitCount;
+  int MissCount;
+  QMutex Mutex;
+  QWaitCondition EncodingFinished;
+};
+
+#endif
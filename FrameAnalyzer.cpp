@@ -0,0 +1,678 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "FrameAnalyzer.hpp"
+
+#include "TableView.hpp"
+
+#include <MECalibration.hpp>
+#include <MEImage.hpp>
+
+#include <MCLog.hpp>
+
+#include <opencv/cv.h>
+
+#include <algorithm>
+#include <math.h>
+
+namespace
+{
+// Average brightness level under the lights are considered off
+const float DarkBrightnessLevel = 10;
+// Distance between the sampled pixels of the brightness check
+const int BrightnessSampleStep = 8;
+// Margin around the table quadrilateral for the motion detection without the rectified view
+const int TableMargin = 10;
+// Sampled points per edge when a region is mapped back to the raw frame
+const int RegionEdgeSamples = 8;
+// Fixed point iterations of the inverse lens distortion
+const int UndistortIterations = 5;
+
+void PasteImage(const MEImage& source, MEImage& target, int x, int y)
+{
+  const IplImage* Source = source.GetIplImage();
+  IplImage* Target = target.GetIplImage();
+  const int Width = std::min(Source->width, Target->width-x)*Source->nChannels;
+  const int Height = std::min(Source->height, Target->height-y);
+
+  if (Source->nChannels != Target->nChannels || Width <= 0 || Height <= 0)
+    return;
+
+  for (int i = 0; i < Height; ++i)
+  {
+    memcpy(Target->imageData+(y+i)*Target->widthStep+x*Target->nChannels, Source->imageData+i*Source->widthStep, Width);
+  }
+}
+
+
+int MaskImage(MEImage& image, const MEImage& mask)
+{
+  IplImage* Image = image.GetIplImage();
+  const IplImage* Mask = mask.GetIplImage();
+  int PixelCount = 0;
+
+  if (Image->width != Mask->width || Image->height != Mask->height || Image->nChannels != 1)
+    return 0;
+
+  for (int y = 0; y < Image->height; ++y)
+  {
+    unsigned char* ImageRow = (unsigned char*)Image->imageData+y*Image->widthStep;
+    const unsigned char* MaskRow = (const unsigned char*)Mask->imageData+y*Mask->widthStep;
+
+    for (int x = 0; x < Image->width; ++x)
+    {
+      ImageRow[x] &= MaskRow[x];
+      PixelCount += (ImageRow[x] > 0);
+    }
+  }
+  return PixelCount;
+}
+}
+
+FrameResult::FrameResult() : Brightness(0), Dark(false), TableDetected(false), MissingCorners(false), MotionRatio(0)
+{
+}
+
+
+FrameAnalyzer::FrameAnalyzer(int frame_width, int frame_height, bool logging) : FrameWidth(frame_width),
+  FrameHeight(frame_height), Logging(logging), LumaImage(new MEImage), MotionImage(new MEImage),
+  RotationAngle(MCFloatInfinity()), MotionRegionX1(-1), MotionRegionY1(-1), MotionRegionX2(-1), MotionRegionY2(-1),
+  MaskPixelCount(0), Undistort(true), LightsOff(false), HasSnapshot(false), MotionRestored(false),
+  RestoreAttempts(0), SnapshotFrameCount(0), CachedRotation(false), CacheSaved(false)
+{
+  // Set the calibration data manually because the portable archive does not work by some reason
+//  MCBinaryData DataBuffer;
+
+//  DataBuffer.LoadFromQtResource(":/rpi.cal");
+//  Calibration.reset(MECalibration::Decode(DataBuffer));
+
+  MC::FloatTable& Intrinsics = CalibrationState.Intrinsics;
+  MC::FloatList& DistortionCoefficients = CalibrationState.DistortionCoefficients;
+
+  CalibrationState.FrameWidth = FrameWidth;
+  CalibrationState.FrameHeight = FrameHeight;
+  Intrinsics.resize(3);
+  Intrinsics[0].push_back(166);
+  Intrinsics[0].push_back(0);
+  Intrinsics[0].push_back(160);
+  Intrinsics[1].push_back(0);
+  Intrinsics[1].push_back(154);
+  Intrinsics[1].push_back(90);
+  Intrinsics[2].push_back(0);
+  Intrinsics[2].push_back(0);
+  Intrinsics[2].push_back(1);
+  DistortionCoefficients.push_back(-0.12);
+  DistortionCoefficients.push_back(0.02);
+  DistortionCoefficients.push_back(0.030);
+  DistortionCoefficients.push_back(0.01);
+  DistortionCoefficients.push_back(0.03);
+  Calibration.reset(new MECalibration(FrameWidth, FrameHeight, Intrinsics, DistortionCoefficients));
+  // Set table marker finder
+  Markers.reset(new TableMarkers(FrameWidth, FrameHeight, Logging));
+  // Set the rectified table view (the table is 274x152.5 cm)
+  RectifiedView.reset(new TableView(156, 92, 9));
+  TableImage.reset(new MEImage(RectifiedView->GetWidth(), RectifiedView->GetHeight(), 1));
+  // Set motion detection
+  MotionDetection.reset(new MotionDetector(4));
+}
+
+
+FrameAnalyzer::~FrameAnalyzer()
+{
+}
+
+
+float FrameAnalyzer::SampleBrightness(const MEImage& image)
+{
+  const IplImage* Image = image.GetIplImage();
+
+  if (!Image || Image->width <= BrightnessSampleStep / 2 || Image->height <= BrightnessSampleStep / 2)
+    return 0;
+
+  const int Channels = Image->nChannels;
+  unsigned int Sum = 0;
+  int SampleCount = 0;
+
+  for (int y = BrightnessSampleStep / 2; y < Image->height; y += BrightnessSampleStep)
+  {
+    const unsigned char* Row = (const unsigned char*)Image->imageData+y*Image->widthStep;
+
+    for (int x = BrightnessSampleStep / 2; x < Image->width; x += BrightnessSampleStep)
+    {
+      for (int c = 0; c < Channels; ++c)
+        Sum += Row[x*Channels+c];
+      SampleCount++;
+    }
+  }
+  return (float)Sum / (SampleCount*Channels);
+}
+
+
+void FrameAnalyzer::ConvertToLuma(const MEImage& image, int width, int height, MEImage& luma)
+{
+  const IplImage* Source = image.GetIplImage();
+  const int Channels = Source->nChannels;
+
+  if (Channels == 1)
+  {
+    // Already a luma plane
+    luma = image;
+    if (luma.GetWidth() != width || luma.GetHeight() != height)
+      luma.Resize(width, height);
+    return;
+  }
+
+  if (Channels != 3 || !((Source->width == width && Source->height == height) ||
+      (Source->width == width*2 && Source->height == height*2)))
+  {
+    // Unusual capture format or size
+    luma = image;
+    luma.ConvertToGrayscale();
+    luma.Resize(width, height);
+    return;
+  }
+  if (luma.GetWidth() != width || luma.GetHeight() != height || luma.GetLayers() != 1)
+    luma = MEImage(width, height, 1);
+
+  IplImage* Target = luma.GetIplImage();
+  const int Scale = Source->width / width;
+
+  for (int y = 0; y < height; ++y)
+  {
+    const unsigned char* Row = (const unsigned char*)Source->imageData+y*Scale*Source->widthStep;
+    unsigned char* TargetRow = (unsigned char*)Target->imageData+y*Target->widthStep;
+
+    if (Scale == 1)
+    {
+      for (int x = 0; x < width; ++x)
+      {
+        const unsigned char* Pixel = Row+x*3;
+
+        // BGR pixel order
+        TargetRow[x] = (unsigned char)((29*Pixel[0]+150*Pixel[1]+77*Pixel[2]) >> 8);
+      }
+      continue;
+    }
+    // Average the 2x2 blocks for the half resolution
+    const unsigned char* NextRow = Row+Source->widthStep;
+
+    for (int x = 0; x < width; ++x)
+    {
+      const unsigned char* Pixel = Row+x*6;
+      const unsigned char* NextPixel = NextRow+x*6;
+      const int B = Pixel[0]+Pixel[3]+NextPixel[0]+NextPixel[3];
+      const int G = Pixel[1]+Pixel[4]+NextPixel[1]+NextPixel[4];
+      const int R = Pixel[2]+Pixel[5]+NextPixel[2]+NextPixel[5];
+
+      TargetRow[x] = (unsigned char)((29*B+150*G+77*R) >> 10);
+    }
+  }
+}
+
+
+
+bool FrameAnalyzer::IsDark(float brightness)
+{
+  return brightness < DarkBrightnessLevel;
+}
+
+
+void FrameAnalyzer::UseCalibrationCache(const QString& file_name)
+{
+  CacheFile = file_name;
+  // Use the rotation and the table corners of the previous run, they are verified on the first frames
+  CalibrationData Cache;
+
+  if (!CalibrationCache::Load(CacheFile, Cache) || Cache.FrameWidth != FrameWidth ||
+      Cache.FrameHeight != FrameHeight || !Cache.Markers.Locked)
+  {
+    return;
+  }
+  // The compiled-in intrinsics are authoritative, the rotation and the corners depend on them
+  if (!IsSameCalibration(Cache))
+  {
+    if (Logging)
+      MC_LOG("The calibration cache was written with different intrinsics, ignored");
+    return;
+  }
+  RotationAngle = Cache.RotationAngle;
+  RotationCenter = Cache.RotationCenter;
+  MarkerSnapshot = Cache.Markers;
+  HasSnapshot = true;
+  RestoreAttempts = 10;
+  CachedRotation = true;
+  if (Logging)
+    MC_LOG("Calibration cache loaded (rotation: %1.2f degrees)", RotationAngle);
+}
+
+
+void FrameAnalyzer::SetUndistort(bool undistort)
+{
+  Undistort = undistort;
+}
+
+
+bool FrameAnalyzer::IsLightsOff() const
+{
+  return LightsOff;
+}
+
+
+void FrameAnalyzer::Analyze(const MEImage& frame, float brightness, FrameResult& result)
+{
+  result = FrameResult();
+  result.Brightness = brightness;
+  // Skip all image processing in the dark
+  if (IsDark(brightness))
+  {
+    if (!LightsOff)
+    {
+      if (Logging)
+        MC_LOG("Lights off");
+      LightsOff = true;
+      Markers->Reset();
+      MotionDetection->Reset();
+    }
+    result.Dark = true;
+    return;
+  }
+  // All analysis runs on the luma plane, the colour image is only converted for the display
+  ConvertToLuma(frame, FrameWidth, FrameHeight, *LumaImage);
+  CorrectImage(*LumaImage);
+  if (LightsOff)
+  {
+    // Try to restore the state before the lights off in the next frames
+    if (Logging)
+      MC_LOG("Lights on");
+    LightsOff = false;
+    RestoreAttempts = (HasSnapshot ? 10 : 0);
+  }
+  // Corner detection
+  if (RestoreAttempts > 0)
+    RestoreSnapshot();
+  Markers->AddImage(*LumaImage);
+  // TODO: The rotational correction is too CPU expensive
+  if (Markers->IsReady() && !Markers->IsAnyMissingCorner() && MCIsFloatInfinity(RotationAngle))
+  {
+    // Get the rotational angle and reset the marker detection
+    Markers->GetRotationalCorrection(*LumaImage, RotationAngle, RotationCenter);
+    if (Logging)
+      MC_LOG("Detected rotation: %1.2f degrees", RotationAngle);
+    Markers->Reset();
+  }
+  // Motion detection on the rectified table view
+  UpdateTableView();
+  if (RectifiedView->IsValid())
+  {
+    RectifiedView->Rectify(*LumaImage, *TableImage);
+    MotionDetection->DetectMotions(*TableImage);
+  } else {
+    // Without the homography the motions are still restricted to the table region
+    UpdateMotionRegion();
+    LumaImage->CopyImagePart(MotionRegionX1, MotionRegionY1, MotionRegionX2, MotionRegionY2, *MotionImage);
+    MotionImage->Resize(MotionMask->GetWidth(), MotionMask->GetHeight());
+    MotionDetection->DetectMotions(*MotionImage);
+  }
+  if (MotionRestored)
+  {
+    MotionRestored = false;
+    if (MotionDetection->GetMotionRatio() > 0.5)
+    {
+      if (Logging)
+        MC_LOG("The restored background model does not match the scene");
+      MotionDetection->Reset();
+    }
+  }
+  // Keep a recent snapshot for the next lights off
+  if (Markers->IsTracking() && RectifiedView->IsValid() && ++SnapshotFrameCount >= 150)
+  {
+    Markers->SaveSnapshot(MarkerSnapshot);
+    MotionDetection->SaveSnapshot(MotionSnapshot);
+    HasSnapshot = true;
+    SnapshotFrameCount = 0;
+    if (!CacheSaved && !CacheFile.isEmpty())
+      SaveCalibrationCache();
+  }
+  result.TableDetected = Markers->GetTableCorners(result.Corners);
+  result.MissingCorners = Markers->IsReady() && Markers->IsAnyMissingCorner();
+  result.MotionRatio = GetMotionRatio();
+}
+
+
+void FrameAnalyzer::CorrectImage(MEImage& image)
+{
+  if (!Undistort || image.GetWidth() != FrameWidth || image.GetHeight() != FrameHeight)
+    return;
+
+  Calibration->Undistort(image);
+  // TODO: The rotational correction is too CPU expensive
+  if (!MCIsFloatInfinity(RotationAngle))
+  {
+    image.Rotate(RotationCenter.X, RotationCenter.Y, RotationAngle);
+  }
+}
+
+
+void FrameAnalyzer::MapToRawFrame(float x, float y, float& raw_x, float& raw_y) const
+{
+  raw_x = x;
+  raw_y = y;
+  if (!Undistort)
+    return;
+
+  // Undo the rotation of CorrectImage() around the same center
+  if (!MCIsFloatInfinity(RotationAngle))
+  {
+    const float Angle = RotationAngle*(float)M_PI / 180;
+    const float DiffX = x-RotationCenter.X;
+    const float DiffY = y-RotationCenter.Y;
+
+    raw_x = RotationCenter.X+cosf(Angle)*DiffX-sinf(Angle)*DiffY;
+    raw_y = RotationCenter.Y+sinf(Angle)*DiffX+cosf(Angle)*DiffY;
+  }
+  // The undistortion samples every pixel from its distorted position in the raw frame
+  const MC::FloatTable& Intrinsics = CalibrationState.Intrinsics;
+  const MC::FloatList& Coefficients = CalibrationState.DistortionCoefficients;
+  const float NormX = (raw_x-Intrinsics[0][2]) / Intrinsics[0][0];
+  const float NormY = (raw_y-Intrinsics[1][2]) / Intrinsics[1][1];
+  const float Radius2 = NormX*NormX+NormY*NormY;
+  const float Radial = 1+Coefficients[0]*Radius2+Coefficients[1]*Radius2*Radius2+
+                       Coefficients[4]*Radius2*Radius2*Radius2;
+  const float DistortedX = NormX*Radial+2*Coefficients[2]*NormX*NormY+Coefficients[3]*(Radius2+2*NormX*NormX);
+  const float DistortedY = NormY*Radial+Coefficients[2]*(Radius2+2*NormY*NormY)+2*Coefficients[3]*NormX*NormY;
+
+  raw_x = DistortedX*Intrinsics[0][0]+Intrinsics[0][2];
+  raw_y = DistortedY*Intrinsics[1][1]+Intrinsics[1][2];
+}
+
+
+void FrameAnalyzer::MapFromRawFrame(float raw_x, float raw_y, float& x, float& y) const
+{
+  x = raw_x;
+  y = raw_y;
+  if (!Undistort)
+    return;
+
+  // The distortion has no closed inverse, it is solved iteratively like cvUndistortPoints()
+  const MC::FloatTable& Intrinsics = CalibrationState.Intrinsics;
+  const MC::FloatList& Coefficients = CalibrationState.DistortionCoefficients;
+  const float DistortedX = (raw_x-Intrinsics[0][2]) / Intrinsics[0][0];
+  const float DistortedY = (raw_y-Intrinsics[1][2]) / Intrinsics[1][1];
+  float NormX = DistortedX;
+  float NormY = DistortedY;
+
+  for (int i = 0; i < UndistortIterations; ++i)
+  {
+    const float Radius2 = NormX*NormX+NormY*NormY;
+    const float Radial = 1+Coefficients[0]*Radius2+Coefficients[1]*Radius2*Radius2+
+                         Coefficients[4]*Radius2*Radius2*Radius2;
+    const float DeltaX = 2*Coefficients[2]*NormX*NormY+Coefficients[3]*(Radius2+2*NormX*NormX);
+    const float DeltaY = Coefficients[2]*(Radius2+2*NormY*NormY)+2*Coefficients[3]*NormX*NormY;
+
+    NormX = (DistortedX-DeltaX) / Radial;
+    NormY = (DistortedY-DeltaY) / Radial;
+  }
+  x = NormX*Intrinsics[0][0]+Intrinsics[0][2];
+  y = NormY*Intrinsics[1][1]+Intrinsics[1][2];
+  // Apply the rotation of CorrectImage() around the same center
+  if (!MCIsFloatInfinity(RotationAngle))
+  {
+    const float Angle = RotationAngle*(float)M_PI / 180;
+    const float DiffX = x-RotationCenter.X;
+    const float DiffY = y-RotationCenter.Y;
+
+    x = RotationCenter.X+cosf(Angle)*DiffX+sinf(Angle)*DiffY;
+    y = RotationCenter.Y-sinf(Angle)*DiffX+cosf(Angle)*DiffY;
+  }
+}
+
+
+bool FrameAnalyzer::GetRawTableRegion(int margin, int width, int height, int& x1, int& y1, int& x2, int& y2)
+{
+  int X1, Y1, X2, Y2;
+
+  if (!Markers->GetTableRegion(margin, X1, Y1, X2, Y2))
+    return false;
+
+  // The straight edges of the region are curved in the raw frame, their samples give the bounding box
+  float MinX = width;
+  float MinY = height;
+  float MaxX = 0;
+  float MaxY = 0;
+
+  for (int i = 0; i <= RegionEdgeSamples; ++i)
+  {
+    const float EdgeX = X1+(float)(X2-X1)*i / RegionEdgeSamples;
+    const float EdgeY = Y1+(float)(Y2-Y1)*i / RegionEdgeSamples;
+    const float Points[4][2] = { { EdgeX, (float)Y1 }, { EdgeX, (float)Y2 }, { (float)X1, EdgeY }, { (float)X2, EdgeY } };
+
+    for (int p = 0; p < 4; ++p)
+    {
+      float RawX, RawY;
+
+      MapToRawFrame(Points[p][0], Points[p][1], RawX, RawY);
+      MinX = std::min(MinX, RawX);
+      MinY = std::min(MinY, RawY);
+      MaxX = std::max(MaxX, RawX);
+      MaxY = std::max(MaxY, RawY);
+    }
+  }
+  const float ScaleX = (float)width / FrameWidth;
+  const float ScaleY = (float)height / FrameHeight;
+
+  x1 = MCBound(0, (int)floorf(MinX*ScaleX), width-1);
+  y1 = MCBound(0, (int)floorf(MinY*ScaleY), height-1);
+  x2 = MCBound(0, (int)ceilf((MaxX+1)*ScaleX)-1, width-1);
+  y2 = MCBound(0, (int)ceilf((MaxY+1)*ScaleY)-1, height-1);
+  return x2 > x1 && y2 > y1;
+}
+
+
+void FrameAnalyzer::GetMotionsMask(MEImage& mask)
+{
+  // The mask is in the rectified table view when the table is known, otherwise in the motion region
+  MotionDetection->GetMotionsMask(mask);
+  // Drop the motions outside of the table area
+  if (!RectifiedView->IsValid() && MotionMask.get())
+    MaskImage(mask, *MotionMask);
+}
+
+
+void FrameAnalyzer::GetFrameMotionsMask(MEImage& mask)
+{
+  MEImage MaskImage;
+
+  GetMotionsMask(MaskImage);
+  if (RectifiedView->IsValid())
+  {
+    mask = MEImage(FrameWidth, FrameHeight, 1);
+    mask.Clear();
+    RectifiedView->ProjectMask(MaskImage, mask);
+  } else
+  if (MotionMask.get())
+  {
+    MaskImage.Resize(MotionRegionX2-MotionRegionX1, MotionRegionY2-MotionRegionY1);
+    mask = MEImage(FrameWidth, FrameHeight, 1);
+    mask.Clear();
+    PasteImage(MaskImage, mask, MotionRegionX1, MotionRegionY1);
+  }
+}
+
+
+TableMarkers& FrameAnalyzer::GetMarkers()
+{
+  return *Markers;
+}
+
+
+void FrameAnalyzer::UpdateTableView()
+{
+  MEPoint Corners[4];
+
+  // The corners do not change while the markers are tracked
+  if (!RectifiedView->IsValid() && Markers->GetTableCorners(Corners))
+  {
+    if (RectifiedView->SetCorners(Corners))
+    {
+      if (Logging)
+        MC_LOG("Rectified table view: (%d, %d) (%d, %d) (%d, %d) (%d, %d)", Corners[0].X, Corners[0].Y,
+               Corners[1].X, Corners[1].Y, Corners[2].X, Corners[2].Y, Corners[3].X, Corners[3].Y);
+      MotionDetection->Reset();
+    }
+  } else
+  if (RectifiedView->IsValid() && !Markers->IsTracking())
+  {
+    RectifiedView->Reset();
+    MotionDetection->Reset();
+    CacheSaved = false;
+  }
+}
+
+
+void FrameAnalyzer::UpdateMotionRegion()
+{
+  int X1 = 0;
+  int Y1 = 0;
+  int X2 = FrameWidth-1;
+  int Y2 = FrameHeight-1;
+
+  // Use the full frame until the table corners are known
+  Markers->GetTableRegion(TableMargin, X1, Y1, X2, Y2);
+  if (MotionMask.get() && X1 == MotionRegionX1 && Y1 == MotionRegionY1 && X2 == MotionRegionX2 && Y2 == MotionRegionY2)
+    return;
+
+  // Keep the pixel count of the full frame analysis, a smaller region gets a higher resolution
+  const float PixelBudget = (float)(FrameWidth / 2)*(FrameHeight / 2);
+  const float Scale = std::min(1.0f, sqrtf(PixelBudget / ((X2-X1)*(Y2-Y1))));
+
+  MotionRegionX1 = X1;
+  MotionRegionY1 = Y1;
+  MotionRegionX2 = X2;
+  MotionRegionY2 = Y2;
+  MotionMask.reset(new MEImage(std::max(8, (int)((X2-X1)*Scale)), std::max(8, (int)((Y2-Y1)*Scale)), 1));
+  Markers->CreateTableMask(TableMargin, X1, Y1, X2, Y2, *MotionMask);
+  MaskPixelCount = 0;
+  for (int y = 0; y < MotionMask->GetHeight(); ++y)
+  {
+    const unsigned char* Row = (const unsigned char*)MotionMask->GetIplImage()->imageData+
+                               y*MotionMask->GetIplImage()->widthStep;
+
+    for (int x = 0; x < MotionMask->GetWidth(); ++x)
+      MaskPixelCount += (Row[x] > 0);
+  }
+  // The background model is bound to the region
+  MotionDetection->Reset();
+  if (Logging)
+    MC_LOG("Motion detection region: %dx%d-%dx%d (analysed in %dx%d)", X1, Y1, X2, Y2,
+           MotionMask->GetWidth(), MotionMask->GetHeight());
+}
+
+
+float FrameAnalyzer::GetMotionRatio()
+{
+  if (RectifiedView->IsValid() || !MotionMask.get() || MaskPixelCount == 0)
+    return MotionDetection->GetMotionRatio();
+
+  // Only the motions inside the table quadrilateral count
+  MEImage Motions;
+
+  MotionDetection->GetMotionsMask(Motions);
+  return (float)MaskImage(Motions, *MotionMask) / MaskPixelCount;
+}
+
+
+bool FrameAnalyzer::IsSameCalibration(const CalibrationData& data) const
+{
+  const MC::FloatTable& Intrinsics = CalibrationState.Intrinsics;
+  const MC::FloatList& DistortionCoefficients = CalibrationState.DistortionCoefficients;
+
+  if (data.Intrinsics.size() != Intrinsics.size() ||
+      data.DistortionCoefficients.size() != DistortionCoefficients.size())
+  {
+    return false;
+  }
+  for (unsigned int i = 0; i < Intrinsics.size(); ++i)
+  {
+    if (data.Intrinsics[i].size() != Intrinsics[i].size())
+      return false;
+
+    for (unsigned int j = 0; j < Intrinsics[i].size(); ++j)
+    {
+      if (fabsf(data.Intrinsics[i][j]-Intrinsics[i][j]) > 1e-4)
+        return false;
+    }
+  }
+  for (unsigned int i = 0; i < DistortionCoefficients.size(); ++i)
+  {
+    if (fabsf(data.DistortionCoefficients[i]-DistortionCoefficients[i]) > 1e-4)
+      return false;
+  }
+  return true;
+}
+
+
+void FrameAnalyzer::RestoreSnapshot()
+{
+  RestoreAttempts--;
+  if (!Markers->RestoreSnapshot(MarkerSnapshot, *LumaImage))
+  {
+    if (RestoreAttempts > 0)
+      return;
+
+    if (CachedRotation)
+    {
+      // The camera has been moved since the cache was written, learn everything again
+      if (Logging)
+        MC_LOG("The calibration cache does not match the camera view");
+      RotationAngle = MCFloatInfinity();
+      CachedRotation = false;
+      HasSnapshot = false;
+      Markers->Reset();
+    } else {
+      if (Logging)
+        MC_LOG("The table corners moved during the lights off");
+    }
+    return;
+  }
+  MEPoint Corners[4];
+
+  Markers->GetTableCorners(Corners);
+  RectifiedView->SetCorners(Corners);
+  MotionRestored = MotionDetection->RestoreSnapshot(MotionSnapshot);
+  RestoreAttempts = 0;
+  CachedRotation = false;
+  if (Logging)
+    MC_LOG("Table corners and background model restored");
+}
+
+
+void FrameAnalyzer::SaveCalibrationCache()
+{
+  if (MCIsFloatInfinity(RotationAngle))
+    return;
+
+  CalibrationState.RotationAngle = RotationAngle;
+  CalibrationState.RotationCenter = RotationCenter;
+  Markers->SaveSnapshot(CalibrationState.Markers);
+  CacheSaved = CalibrationCache::Save(CacheFile, CalibrationState);
+  if (CacheSaved && Logging)
+    MC_LOG("Calibration cache saved");
+}
@@ -0,0 +1,128 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef FrameAnalyzer_hpp
+#define FrameAnalyzer_hpp
+
+#include "CalibrationCache.hpp"
+#include "MotionDetector.hpp"
+#include "TableMarkers.hpp"
+
+#include <MEDefs.hpp>
+
+#include <qstring.h>
+
+#include <boost/scoped_ptr.hpp>
+
+class MECalibration;
+class MEImage;
+class TableView;
+
+/**
+ * Analysis results of a single frame.
+ */
+struct FrameResult
+{
+  FrameResult();
+
+  float Brightness;
+  bool Dark;
+  bool TableDetected;
+  MEPoint Corners[4];
+  bool MissingCorners;
+  float MotionRatio;
+};
+
+/**
+ * Table and motion analysis of the consecutive frames of a camera.
+ *
+ * The analyzer owns all state which evolves from frame to frame: the
+ * calibration and the rotation, the table markers, the rectified table view,
+ * the motion detector and the snapshots taken for the lights off periods.
+ * The live video watcher and the offline analysis use the same pipeline.
+ * The results are in the corrected (undistorted and rotated) frame of the
+ * analysed resolution, MapToRawFrame() maps them back to the raw frame and
+ * MapFromRawFrame() maps the raw frame positions into the corrected frame.
+ */
+class FrameAnalyzer
+{
+public:
+  FrameAnalyzer(int frame_width, int frame_height, bool logging);
+  ~FrameAnalyzer();
+
+  static float SampleBrightness(const MEImage& image);
+  static void ConvertToLuma(const MEImage& image, int width, int height, MEImage& luma);
+  static bool IsDark(float brightness);
+
+  void UseCalibrationCache(const QString& file_name);
+  void SetUndistort(bool undistort);
+  bool IsLightsOff() const;
+  void Analyze(const MEImage& frame, float brightness, FrameResult& result);
+  void CorrectImage(MEImage& image);
+  void MapToRawFrame(float x, float y, float& raw_x, float& raw_y) const;
+  void MapFromRawFrame(float raw_x, float raw_y, float& x, float& y) const;
+  bool GetRawTableRegion(int margin, int width, int height, int& x1, int& y1, int& x2, int& y2);
+  void GetMotionsMask(MEImage& mask);
+  void GetFrameMotionsMask(MEImage& mask);
+  TableMarkers& GetMarkers();
+
+private:
+  void UpdateTableView();
+  void UpdateMotionRegion();
+  float GetMotionRatio();
+  bool IsSameCalibration(const CalibrationData& data) const;
+  void RestoreSnapshot();
+  void SaveCalibrationCache();
+
+protected:
+  const int FrameWidth;
+  const int FrameHeight;
+  const bool Logging;
+  boost::scoped_ptr<MECalibration> Calibration;
+  boost::scoped_ptr<MEImage> LumaImage;
+  boost::scoped_ptr<MEImage> MotionImage;
+  boost::scoped_ptr<MEImage> TableImage;
+  boost::scoped_ptr<MEImage> MotionMask;
+  boost::scoped_ptr<TableMarkers> Markers;
+  boost::scoped_ptr<TableView> RectifiedView;
+  boost::scoped_ptr<MotionDetector> MotionDetection;
+  float RotationAngle;
+  MEPoint RotationCenter;
+  int MotionRegionX1;
+  int MotionRegionY1;
+  int MotionRegionX2;
+  int MotionRegionY2;
+  int MaskPixelCount;
+  bool Undistort;
+  bool LightsOff;
+  bool HasSnapshot;
+  bool MotionRestored;
+  int RestoreAttempts;
+  int SnapshotFrameCount;
+  TableMarkers::Snapshot MarkerSnapshot;
+  MotionDetector::Snapshot MotionSnapshot;
+  CalibrationData CalibrationState;
+  QString CacheFile;
+  bool CachedRotation;
+  bool CacheSaved;
+};
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "FrameHandle.hpp"
+
+#include <MEImage.hpp>
+
+FrameHandle::FrameHandle() : Sequence(-1)
+{
+}
+
+
+FrameHandle::FrameHandle(MEImage* image, int sequence) : Image(image), Sequence(sequence)
+{
+}
+
+
+FrameHandle::FrameHandle(const boost::shared_ptr<MEImage>& image, int sequence) : Image(image), Sequence(sequence)
+{
+}
+
+
+bool FrameHandle::IsNull() const
+{
+  return !Image.get();
+}
+
+
+int FrameHandle::GetSequence() const
+{
+  return Sequence;
+}
+
+
+const MEImage& FrameHandle::GetImage() const
+{
+  return *Image;
+}
+
+
+MEImage& FrameHandle::Detach()
+{
+  if (!Image.get())
+  {
+    Image.reset(new MEImage);
+  } else
+  if (!Image.unique())
+  {
+    Image.reset(new MEImage(*Image));
+  }
+  return *Image;
+}
+
+
+boost::shared_ptr<MEImage> FrameHandle::ReleaseBuffer()
+{
+  boost::shared_ptr<MEImage> Buffer;
+
+  // The buffer can be reused only when no other handle refers to it
+  if (Image.get() && Image.unique())
+    Buffer = Image;
+  else
+    Buffer.reset(new MEImage);
+
+  Image.reset();
+  Sequence = -1;
+  return Buffer;
+}
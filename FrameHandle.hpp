@@ -0,0 +1,54 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef FrameHandle_hpp
+#define FrameHandle_hpp
+
+#include <boost/shared_ptr.hpp>
+
+class MEImage;
+
+/**
+ * Reference-counted handle of a captured frame.
+ *
+ * The copies of a handle share the same pixel buffer. The buffer is treated
+ * as immutable, the stages that draw on a frame call Detach() to get their
+ * own copy when the buffer is shared with an other handle.
+ */
+class FrameHandle
+{
+public:
+  FrameHandle();
+  FrameHandle(MEImage* image, int sequence);
+  FrameHandle(const boost::shared_ptr<MEImage>& image, int sequence);
+
+  bool IsNull() const;
+  int GetSequence() const;
+  const MEImage& GetImage() const;
+  MEImage& Detach();
+  boost::shared_ptr<MEImage> ReleaseBuffer();
+
+protected:
+  boost::shared_ptr<MEImage> Image;
+  int Sequence;
+};
+
+#endif
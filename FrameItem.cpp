@@ -0,0 +1,93 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "FrameItem.hpp"
+
+#include <MEImage.hpp>
+
+#include <QMutexLocker>
+#include <qquickwindow.h>
+#include <qsgsimpletexturenode.h>
+
+FrameItem::FrameItem(QQuickItem* parent) : QQuickItem(parent), FrameChanged(false)
+{
+  setFlag(QQuickItem::ItemHasContents, true);
+}
+
+
+FrameItem::~FrameItem()
+{
+}
+
+
+void FrameItem::SetFrame(const FrameHandle& frame)
+{
+  {
+    QMutexLocker Lock(&FrameMutex);
+
+    Frame = frame;
+    FrameChanged = true;
+  }
+  update();
+}
+
+
+QSGNode* FrameItem::updatePaintNode(QSGNode* old_node, UpdatePaintNodeData* data)
+{
+  Q_UNUSED(data);
+
+  QSGSimpleTextureNode* Node = static_cast<QSGSimpleTextureNode*>(old_node);
+  FrameHandle CurrentFrame;
+
+  {
+    QMutexLocker Lock(&FrameMutex);
+
+    if (FrameChanged)
+      CurrentFrame = Frame;
+    FrameChanged = false;
+  }
+  if (!CurrentFrame.IsNull())
+  {
+    const MEImage& Image = CurrentFrame.GetImage();
+    const IplImage* Source = Image.GetIplImage();
+
+    if (Image.GetLayers() == 3 || Image.GetLayers() == 1)
+    {
+      // Wrap the pixel buffer of the frame without a copy, the texture upload copies it
+      const QImage Wrapper((const uchar*)Source->imageData, Image.GetWidth(), Image.GetHeight(), Source->widthStep,
+                           Image.GetLayers() == 3 ? QImage::Format_RGB888 : QImage::Format_Grayscale8);
+      QSGTexture* Texture = window()->createTextureFromImage(Wrapper);
+
+      if (!Node)
+      {
+        Node = new QSGSimpleTextureNode;
+        // The node deletes the previous texture in setTexture() and the last one with itself
+        Node->setOwnsTexture(true);
+      }
+      Node->setTexture(Texture);
+      // The texture may upload the wrapped buffer later, keep the frame alive until the next one
+      DisplayedFrame = CurrentFrame;
+    }
+  }
+  if (Node)
+    Node->setRect(boundingRect());
+  return Node;
+}
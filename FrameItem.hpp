@@ -0,0 +1,54 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef FrameItem_hpp
+#define FrameItem_hpp
+
+#include "FrameHandle.hpp"
+
+#include <qmutex.h>
+#include <qquickitem.h>
+
+/**
+ * QML item which shows the captured frames directly as a texture.
+ *
+ * The item holds a reference to the RGB buffer of the frame, the only copy
+ * is the texture upload in the render thread.
+ */
+class FrameItem : public QQuickItem
+{
+  Q_OBJECT
+public:
+  FrameItem(QQuickItem* parent = NULL);
+  virtual ~FrameItem();
+
+  void SetFrame(const FrameHandle& frame);
+
+protected:
+  virtual QSGNode* updatePaintNode(QSGNode* old_node, UpdatePaintNodeData* data);
+
+  FrameHandle Frame;
+  FrameHandle DisplayedFrame;
+  bool FrameChanged;
+  QMutex FrameMutex;
+};
+
+#endif
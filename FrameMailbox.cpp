@@ -0,0 +1,85 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "FrameMailbox.hpp"
+
+#include <QMutexLocker>
+
+FrameMailbox::FrameMailbox() : Closed(false), PostedCount(0), ReplacedCount(0)
+{
+}
+
+
+void FrameMailbox::Post(const FrameHandle& frame)
+{
+  QMutexLocker Lock(&Mutex);
+
+  if (Closed)
+    return;
+
+  if (!Slot.IsNull())
+    ReplacedCount++;
+  PostedCount++;
+  Slot = frame;
+  FrameArrived.wakeOne();
+}
+
+
+bool FrameMailbox::Take(FrameHandle& frame)
+{
+  QMutexLocker Lock(&Mutex);
+
+  while (Slot.IsNull() && !Closed)
+    FrameArrived.wait(&Mutex);
+
+  if (Closed)
+    return false;
+
+  frame = Slot;
+  Slot = FrameHandle();
+  return true;
+}
+
+
+void FrameMailbox::Close()
+{
+  QMutexLocker Lock(&Mutex);
+
+  Closed = true;
+  Slot = FrameHandle();
+  FrameArrived.wakeAll();
+}
+
+
+int FrameMailbox::GetPostedCount()
+{
+  QMutexLocker Lock(&Mutex);
+
+  return PostedCount;
+}
+
+
+int FrameMailbox::GetReplacedCount()
+{
+  QMutexLocker Lock(&Mutex);
+
+  return ReplacedCount;
+}
@@ -0,0 +1,56 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef FrameMailbox_hpp
+#define FrameMailbox_hpp
+
+#include "FrameHandle.hpp"
+
+#include <qmutex.h>
+#include <qwaitcondition.h>
+
+/**
+ * Single-slot mailbox between a frame producer and a consumer thread.
+ *
+ * A new frame replaces the one which has not been taken yet, the consumer
+ * always works on the newest frame and the stale ones never pile up.
+ */
+class FrameMailbox
+{
+public:
+  FrameMailbox();
+
+  void Post(const FrameHandle& frame);
+  bool Take(FrameHandle& frame);
+  void Close();
+  int GetPostedCount();
+  int GetReplacedCount();
+
+protected:
+  FrameHandle Slot;
+  bool Closed;
+  int PostedCount;
+  int ReplacedCount;
+  QMutex Mutex;
+  QWaitCondition FrameArrived;
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "FrameStreamParser.hpp"
+
+#include <string.h>
+
+namespace
+{
+// Size of the length prefix
+const int HeaderSize = 4;
+}
+
+FrameStreamParser::FrameStreamParser(int max_frame_size) : MaxFrameSize(max_frame_size), ReadOffset(0),
+  WriteOffset(0), Corrupted(false)
+{
+}
+
+
+char* FrameStreamParser::PrepareWrite(int size)
+{
+  // Move the unparsed tail to the front before the buffer would grow
+  if (ReadOffset > 0 && WriteOffset+size > (int)Buffer.size())
+  {
+    memmove(&Buffer[0], &Buffer[ReadOffset], WriteOffset-ReadOffset);
+    WriteOffset -= ReadOffset;
+    ReadOffset = 0;
+  }
+  // The buffer never shrinks, it settles at the size of the largest reads
+  if (WriteOffset+size > (int)Buffer.size())
+    Buffer.resize(WriteOffset+size);
+
+  return &Buffer[WriteOffset];
+}
+
+
+void FrameStreamParser::CommitWrite(int size)
+{
+  WriteOffset += size;
+}
+
+
+bool FrameStreamParser::TakeFrame(QByteArray& frame)
+{
+  if (Corrupted || WriteOffset-ReadOffset < HeaderSize)
+    return false;
+
+  const unsigned char* Header = (const unsigned char*)&Buffer[ReadOffset];
+  const unsigned int Size = ((unsigned int)Header[0] << 24) | ((unsigned int)Header[1] << 16) |
+                            ((unsigned int)Header[2] << 8) | (unsigned int)Header[3];
+
+  if (Size > (unsigned int)MaxFrameSize)
+  {
+    Corrupted = true;
+    return false;
+  }
+  if (WriteOffset-ReadOffset < HeaderSize+(int)Size)
+    return false;
+
+  frame = QByteArray(&Buffer[ReadOffset+HeaderSize], (int)Size);
+  ReadOffset += HeaderSize+(int)Size;
+  // Rewind when everything is parsed, the next read starts at the front
+  if (ReadOffset == WriteOffset)
+  {
+    ReadOffset = 0;
+    WriteOffset = 0;
+  }
+  return true;
+}
+
+
+bool FrameStreamParser::IsCorrupted() const
+{
+  return Corrupted;
+}
+
+
+void FrameStreamParser::Reset()
+{
+  ReadOffset = 0;
+  WriteOffset = 0;
+  Corrupted = false;
+}
@@ -0,0 +1,56 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef FrameStreamParser_hpp
+#define FrameStreamParser_hpp
+
+#include <qbytearray.h>
+
+#include <vector>
+
+/**
+ * Incremental parser of a stream of length-prefixed frames.
+ *
+ * Every frame is a 4-byte big-endian length followed by the frame data. The socket
+ * reads are written directly into a reusable buffer, a read may hold a partial frame
+ * or several frames. The parser is corrupted when a frame is longer than the limit,
+ * the stream can not be resynchronized then and it must be reset with the connection.
+ */
+class FrameStreamParser
+{
+public:
+  FrameStreamParser(int max_frame_size);
+
+  char* PrepareWrite(int size);
+  void CommitWrite(int size);
+  bool TakeFrame(QByteArray& frame);
+  bool IsCorrupted() const;
+  void Reset();
+
+protected:
+  const int MaxFrameSize;
+  std::vector<char> Buffer;
+  int ReadOffset;
+  int WriteOffset;
+  bool Corrupted;
+};
+
+#endif
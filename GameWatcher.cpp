@@ -22,69 +22,72 @@
 #include "GameWatcher.hpp"
 
 #include "AudioWatcher.hpp"
+#include "BroadcastServer.hpp"
+#include "EncodedFrameCache.hpp"
+#include "FrameHandle.hpp"
+#include "FrameItem.hpp"
 #include "ImageSender.hpp"
+#include "OverlayLayer.hpp"
+#include "SharedFrameRing.hpp"
 #include "VideoWatcher.hpp"
 
 #include <MEDefs.hpp>
 #include <MEImage.hpp>
 
-#include <qmetatype.h>
-#include <QtConcurrentRun>
+#include <MCLog.hpp>
 
-#include <boost/bind.hpp>
+#include <qmetatype.h>
 
-static ME::ImageSPtr StaticImage;
+#include <string.h>
 
-ImageProvider::ImageProvider() : QQuickImageProvider(QQuickImageProvider::Image)
+namespace
 {
+// Refresh interval of the displayed and sent image while the table is idle (ms)
+const int IdleRefreshInterval = 5000;
+// Slots and the largest frame (640x360 RGB) of the shared memory ring
+const int SharedRingSlots = 8;
+const int SharedRingFrameSize = 640*360*3;
 }
 
-
-QImage ImageProvider::requestImage(const QString& id, QSize* size, const QSize& requested_size)
-{
-  MC_UNUSED(id);
-  MC_UNUSED(size);
-  MC_UNUSED(requested_size);
-
-  if (StaticImage.get())
-  {
-    MC::BinaryDataSPtr EncodedImage(StaticImage->Compress(ME::JpegFormat));
-
-    if (EncodedImage.get())
-    {
-      if (size)
-        *size = QSize(640, 360);
-
-      return QImage::fromData(EncodedImage->GetData(), EncodedImage->GetSize());
-    }
-  }
-  // Provide a grayscale image
-  QImage Image(640, 360, QImage::Format_RGB888);
-
-  memset(Image.bits(), 100, 640*360*3);
-  return Image;
-}
-
-
 GameWatcher::GameWatcher(const QString& audio_file, const QString& video_file, const QString& wallpi_ip,
-                         QObject* root_object) :
-  Page(NULL), InIdle(true)
+                         int wallpi_byte_rate, bool wallpi_delta_tiles, bool wallpi_udp, int broadcast_port,
+                         const QString& shared_ring_name, QObject* root_object) :
+  CameraView(NULL), EncodedFrames(new EncodedFrameCache(4)), PendingAudioEvents(0), BallMeasured(false),
+  BallTimestamp(0), BallX(0), BallY(0), InIdle(true), IdleOverlay(new OverlayLayer(1)),
+  StatusOverlay(new OverlayLayer(1))
 {
+  IdleOverlay->AddText(350, 320, "Lights off", 1.1, MEColor(255, 255, 255), true);
   qRegisterMetaType<IOP::VideoEventType>("IOP::VideoEventType");
   qRegisterMetaType<IOP::AudioEventType>("IOP::AudioEventType");
   AudioListener.reset(new AudioWatcher(audio_file));
   connect(AudioListener.get(), SIGNAL(AudioEvent(IOP::AudioEventType)),
           this, SLOT(AudioEvent(IOP::AudioEventType)));
+  AudioListener->SetIdle(InIdle);
   if (!wallpi_ip.isEmpty())
-    ImageSocket.reset(new ImageSender(wallpi_ip));
+  {
+    ImageSocket.reset(new ImageSender(wallpi_ip, *EncodedFrames, wallpi_byte_rate, wallpi_delta_tiles,
+                                      wallpi_udp));
+  }
+  if (broadcast_port > 0)
+    Broadcast.reset(new BroadcastServer(broadcast_port, *EncodedFrames, wallpi_byte_rate));
+  if (!shared_ring_name.isEmpty())
+  {
+    SharedFrames.reset(new SharedFrameWriter);
+    if (!SharedFrames->Create(shared_ring_name.toStdString(), SharedRingSlots, SharedRingFrameSize))
+    {
+      MC_LOG("Cannot create the shared frame ring %s", shared_ring_name.toStdString().c_str());
+      SharedFrames.reset();
+    }
+  }
   VideoListener.reset(new VideoWatcher(video_file, audio_file.isEmpty()));
   connect(VideoListener.get(), SIGNAL(VideoEvent(IOP::VideoEventType)),
           this, SLOT(VideoEvent(IOP::VideoEventType)));
+  connect(VideoListener.get(), SIGNAL(BallPosition(int, float, float)), this, SLOT(BallPosition(int, float, float)));
   connect(VideoListener.get(), SIGNAL(StartAudio()), AudioListener.get(), SLOT(StartPlayback()));
   connect(AudioListener.get(), SIGNAL(Timestamp(int)), VideoListener.get(), SLOT(AudioTimestamp(int)));
   if (root_object)
   {
-    Page = root_object->findChild<QObject*>("fuckYoo");
+    CameraView = root_object->findChild<FrameItem*>("cameraFrame");
   }
 }
 
@@ -102,6 +105,8 @@ void GameWatcher::AudioEvent(IOP::AudioEventType event)
     ShowStatusText("Pong");
   if (event == IOP::TalkEvent)
     ShowStatusText("Blabla");
+  // The local consumers get the events with the next frame
+  PendingAudioEvents |= 1u << event;
 }
 
 
@@ -109,40 +114,111 @@ void GameWatcher::VideoEvent(IOP::VideoEventType event)
 {
   if (event == IOP::CaptureEvent)
   {
-    StaticImage.reset(new MEImage(VideoListener->GetCapturedImage()));
+    // The idle frames do not change, refresh them only periodically
+    const bool Refresh = !InIdle || !IdleRefreshTimer.isValid() || IdleRefreshTimer.elapsed() >= IdleRefreshInterval;
+
+    if (!Refresh && !SharedFrames.get())
+      return;
+
+    // The frame is shared with the video watcher, it is copied only when a text is drawn on it
+    FrameHandle Frame = VideoListener->GetCapturedFrame();
+
+    // The local consumers get every frame without the status texts
+    if (SharedFrames.get())
+      PublishSharedFrame(Frame, true);
+    if (!Refresh)
+      return;
+
     if (InIdle)
     {
-      StaticImage->DrawText(350, 320, "Lights off", 1.1, MEColor(255, 255, 255));
+      IdleRefreshTimer.start();
+      IdleOverlay->Composite(Frame.Detach());
     } else
     if (StatusTextTimer.isValid() && StatusTextTimer.elapsed() < 500)
     {
-      StaticImage->DrawText(350, 320, StatusText.toStdString(), 1.1, MEColor(255, 255, 255));
-    }
-    if (Page)
-    {
-      Page->setProperty("cameraImage", "image://camera/image.jpg"+QString::number(MCRand<int>(0, 100000)));
+      StatusOverlay->Composite(Frame.Detach());
     }
+    // The debug view shows the RGB buffer of the frame as a texture
+    if (CameraView)
+      CameraView->SetFrame(Frame);
+    // The compression and the sending run in the threads of the senders
     if (ImageSocket.get())
-    {
-      ImageSocket->SetImage(*StaticImage);
-      // Run the JPEG compression and sending in an other thread
-      QtConcurrent::run(boost::bind(&ImageSender::SendImage, ImageSocket.get()));
-    }
+      ImageSocket->SendFrame(Frame);
+    if (Broadcast.get())
+      Broadcast->SendFrame(Frame);
+  } else
+  if (event == IOP::SkippedFrameEvent)
+  {
+    // The frames between the analysed ones go only to the local consumers
+    if (SharedFrames.get())
+      PublishSharedFrame(VideoListener->GetCapturedFrame(), false);
   } else
   if (event == IOP::NormalEvent && InIdle)
   {
     InIdle = false;
+    AudioListener->SetIdle(false);
   } else
   if (event == IOP::IdleEvent && !InIdle)
   {
     InIdle = true;
+    IdleRefreshTimer = QTime();
+    BallMeasured = false;
+    AudioListener->SetIdle(true);
   }
 }
 
 
+void GameWatcher::BallPosition(int timestamp, float x, float y)
+{
+  // The local consumers get the position with the frame it was measured on
+  BallMeasured = true;
+  BallTimestamp = timestamp;
+  BallX = x;
+  BallY = y;
+}
+
+
 void GameWatcher::ShowStatusText(const QString& text)
 {
   StatusText = text;
   StatusTextTimer.start();
+  // The text is rasterized only once for all frames while it is shown
+  StatusOverlay->ClearCached();
+  StatusOverlay->AddText(350, 320, StatusText.toStdString(), 1.1, MEColor(255, 255, 255), true);
   MC_LOG("Show status text: %s", qPrintable(text));
 }
+
+
+void GameWatcher::PublishSharedFrame(const FrameHandle& frame, bool analysed)
+{
+  const MEImage& Image = frame.GetImage();
+  const IplImage* Source = Image.GetIplImage();
+  const FrameResult& Result = VideoListener->GetFrameResult();
+  SharedFrameMetadata Metadata;
+
+  memset(&Metadata, 0, sizeof(Metadata));
+  // The frame was captured before the analysis, its age is subtracted from the current time
+  Metadata.Timestamp = SharedFrameWriter::GetTimestamp()-VideoListener->GetCaptureAge();
+  Metadata.Brightness = Result.Brightness;
+  Metadata.MotionRatio = Result.MotionRatio;
+  if (Result.TableDetected)
+    VideoListener->GetCaptureCorners(Metadata.Corners);
+  Metadata.Flags = (Result.Dark ? SharedFrameMetadata::DarkFlag : 0) | (InIdle ? SharedFrameMetadata::IdleFlag : 0) |
+                   (Result.TableDetected ? SharedFrameMetadata::TableDetectedFlag : 0) |
+                   (Result.MissingCorners ? SharedFrameMetadata::MissingCornersFlag : 0) |
+                   (VideoListener->IsDebugView() ? SharedFrameMetadata::DebugViewFlag : 0) |
+                   (analysed ? 0 : SharedFrameMetadata::CarriedOverFlag);
+  Metadata.Events = PendingAudioEvents;
+  PendingAudioEvents = 0;
+  // The ball is tracked on every capture before its events, a position belongs to this frame only
+  if (BallMeasured)
+  {
+    Metadata.Flags |= SharedFrameMetadata::BallFlag;
+    Metadata.Ball[0] = BallX;
+    Metadata.Ball[1] = BallY;
+    Metadata.BallTimestamp = BallTimestamp;
+    BallMeasured = false;
+  }
+  SharedFrames->Publish((const unsigned char*)Source->imageData, Image.GetWidth(), Image.GetHeight(),
+                        Source->widthStep, Image.GetLayers(), Metadata);
+}
@@ -25,45 +25,58 @@
 #include "Defines.hpp"
 
 #include <qobject.h>
-#include <qquickimageprovider.h>
 #include <QTime>
 
 #include <boost/scoped_ptr.hpp>
 
 class AudioWatcher;
+class BroadcastServer;
+class EncodedFrameCache;
+class FrameHandle;
+class FrameItem;
 class ImageSender;
+class OverlayLayer;
+class SharedFrameWriter;
 class VideoWatcher;
 
-class ImageProvider : public QQuickImageProvider
-{
-public:
-  ImageProvider();
-
-  virtual QImage requestImage(const QString& id, QSize* size, const QSize& requested_size);
-};
-
 class GameWatcher : public QObject
 {
   Q_OBJECT
 
 public:
-  GameWatcher(const QString& audio_file, const QString& video_file, const QString& wallpi_ip, QObject* root_object);
+  GameWatcher(const QString& audio_file, const QString& video_file, const QString& wallpi_ip, int wallpi_byte_rate,
+              bool wallpi_delta_tiles, bool wallpi_udp, int broadcast_port, const QString& shared_ring_name,
+              QObject* root_object);
   virtual ~GameWatcher();
 
 public Q_SLOTS:
 
   void AudioEvent(IOP::AudioEventType event);
   void VideoEvent(IOP::VideoEventType event);
+  void BallPosition(int timestamp, float x, float y);
   void ShowStatusText(const QString& text);
 
 protected:
-  QObject* Page;
+  void PublishSharedFrame(const FrameHandle& frame, bool analysed);
+
+  FrameItem* CameraView;
   QString StatusText;
   QTime StatusTextTimer;
   boost::scoped_ptr<AudioWatcher> AudioListener;
   boost::scoped_ptr<VideoWatcher> VideoListener;
+  boost::scoped_ptr<EncodedFrameCache> EncodedFrames;
   boost::scoped_ptr<ImageSender> ImageSocket;
+  boost::scoped_ptr<BroadcastServer> Broadcast;
+  boost::scoped_ptr<SharedFrameWriter> SharedFrames;
+  unsigned int PendingAudioEvents;
+  bool BallMeasured;
+  int BallTimestamp;
+  float BallX;
+  float BallY;
   bool InIdle;
+  boost::scoped_ptr<OverlayLayer> IdleOverlay;
+  boost::scoped_ptr<OverlayLayer> StatusOverlay;
+  QTime IdleRefreshTimer;
 };
 
 #endif
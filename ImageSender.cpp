@@ -18,13 +18,12 @@
  *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
  *
  */
-
 #include "ImageSender.hpp"
 
-#include <MECalibration.hpp>
-#include <MEImage.hpp>
+#include "EncodedFrameCache.hpp"
+#include "TileDeltaEncoder.hpp"
 
-#include <MCBinaryData.hpp>
+#include <MEImage.hpp>
 
 #include <qglobal.h>
 #include <qhostaddress.h>
@@ -32,127 +31,619 @@
 #include <QNetworkAddressEntry>
 #include <QTime>
 #include <qtimer.h>
+#include <qudpsocket.h>
 
-#include <boost/make_shared.hpp>
-
-ImageSender::ImageSender(const QString& host_name) : QTcpSocket(), QQuickImageProvider(QQuickImageProvider::Image),
-  Image(new MEImage)
-{
-  // Undistortion parameters for resolution 640x360
-  MC::FloatTable Intrinsics;
-  MC::FloatList DistortionCoefficients;
-
-  Intrinsics.resize(3);
-  Intrinsics[0].push_back(930);
-  Intrinsics[0].push_back(0);
-  Intrinsics[0].push_back(320);
-  Intrinsics[1].push_back(0);
-  Intrinsics[1].push_back(900);
-  Intrinsics[1].push_back(180);
-  Intrinsics[2].push_back(0);
-  Intrinsics[2].push_back(0);
-  Intrinsics[2].push_back(1);
-  DistortionCoefficients.push_back(0.06);
-  DistortionCoefficients.push_back(-4.3);
-  DistortionCoefficients.push_back(0.03);
-  DistortionCoefficients.push_back(0.04);
-  DistortionCoefficients.push_back(0.1);
-  Calibration.reset(new MECalibration(640, 360, Intrinsics, DistortionCoefficients));
-
-  connectToHost(QHostAddress(host_name), 10000);
-  qRegisterMetaType<QAbstractSocket::SocketError>("QAbstractSocket::SocketError");
-  qRegisterMetaType<QAbstractSocket::SocketError>("QAbstractSocket::SocketState");
-  connect(this, SIGNAL(readyRead()), this, SLOT(DataArrived()), Qt::QueuedConnection);
-  connect(this, SIGNAL(error(QAbstractSocket::SocketError)),
+#include <algorithm>
+
+namespace
+{
+const quint16 ImagePort = 10000;
+// Size of the length prefix before every frame
+const int HeaderSize = 4;
+// Maximal amount of data in the write buffer of the socket
+const int ChunkSize = 64*1024;
+// Longest frame accepted from the wall pi
+const int MaxReceivedFrameSize = 16*1024*1024;
+// Delay before the reconnection (ms)
+const int ReconnectDelay = 2000;
+// Period of the statistics report (ms)
+const int StatisticsInterval = 10000;
+// Send buffer of the UDP socket, a few frames fit into it
+const int UdpSendBufferSize = 1024*1024;
+// Quality range of the rate controller
+const int MinJpegQuality = 20;
+const int MaxJpegQuality = 90;
+// Tile size and keyframe interval (frames) of the delta mode
+const int DeltaTileSize = 64;
+const int KeyframeInterval = 30;
+
+
+bool IsDeltaMessage(const QByteArray& data)
+{
+  // The delta messages start with type 1, the keyframes with 0 and the plain JPEG frames with 0xFF
+  return !data.isEmpty() && data[0] == 1;
+}
+}
+
+ImageEncoder::ImageEncoder(FrameMailbox& mailbox, EncodedFrameCache& cache, const QElapsedTimer& clock,
+                           int bytes_per_second, bool delta_tiles) :
+  QThread(), Mailbox(mailbox), Cache(cache), Clock(clock),
+  RateController(bytes_per_second, MinJpegQuality, MaxJpegQuality)
+{
+  if (delta_tiles)
+    DeltaEncoder.reset(new TileDeltaEncoder(DeltaTileSize, KeyframeInterval));
+  Stats.Quality = RateController.GetQuality();
+  Stats.LastFrameSize = 0;
+  Stats.AverageFrameSize = 0;
+  Stats.LastEncodeTime = 0;
+  Stats.AverageEncodeTime = 0;
+  Stats.Keyframes = 0;
+  Stats.AverageTiles = 0;
+}
+
+
+ImageEncoder::~ImageEncoder()
+{
+}
+
+
+ImageEncoder::Statistics ImageEncoder::GetStatistics()
+{
+  QMutexLocker Lock(&StatisticsMutex);
+
+  return Stats;
+}
+
+
+void ImageEncoder::RequestKeyframe()
+{
+  if (DeltaEncoder.get())
+    DeltaEncoder->RequestKeyframe();
+}
+
+
+void ImageEncoder::run()
+{
+  FrameHandle Frame;
+  qint64 PreviousStart = -1;
+  int FrameCount = 0;
+
+  // The mailbox returns false when it is closed
+  while (Mailbox.Take(Frame))
+  {
+    const qint64 EncodeStart = Clock.nsecsElapsed();
+    const int Quality = RateController.GetQuality();
+
+    QByteArray Data;
+    bool Keyframe = true;
+    int Tiles = 1;
+
+    // The frame (or the keyframe in delta mode) is compressed only once for all consumers
+    if (DeltaEncoder.get())
+    {
+      if (!DeltaEncoder->Encode(Frame, Quality, Cache, Data, Keyframe, Tiles))
+        Data.clear();
+    } else {
+      Data = Cache.GetJpeg(Frame, Quality);
+    }
+    const float EncodeTime = (float)(Clock.nsecsElapsed()-EncodeStart) / 1000000;
+    const int FrameInterval = PreviousStart < 0 ? 0 : (int)((EncodeStart-PreviousStart) / 1000000);
+
+    // Release the frame before waiting for the next one
+    Frame = FrameHandle();
+    PreviousStart = EncodeStart;
+    if (Data.isEmpty())
+      continue;
+
+    // The quality follows the size of the full frames, the delta frames scale with the activity
+    if (Keyframe)
+      RateController.Update(Data.size(), FrameInterval);
+    FrameCount++;
+    {
+      QMutexLocker Lock(&StatisticsMutex);
+
+      if (Keyframe && DeltaEncoder.get())
+        Stats.Keyframes++;
+      Stats.AverageTiles = FrameCount == 1 ? Tiles : Stats.AverageTiles*0.9+Tiles*0.1;
+
+      Stats.Quality = Quality;
+      Stats.LastFrameSize = Data.size();
+      Stats.LastEncodeTime = EncodeTime;
+      Stats.AverageFrameSize = FrameCount == 1 ? Data.size() : Stats.AverageFrameSize*0.9+Data.size()*0.1;
+      Stats.AverageEncodeTime = FrameCount == 1 ? EncodeTime : Stats.AverageEncodeTime*0.9+EncodeTime*0.1;
+    }
+    // Nothing changed since the previous frame
+    if (!Keyframe && Tiles == 0)
+      continue;
+
+    Q_EMIT(FrameEncoded(Data, EncodeStart));
+  }
+}
+
+
+ImageDecoder::ImageDecoder() : QThread(), Closed(false)
+{
+  Stats.FramesReceived = 0;
+  Stats.FramesReplaced = 0;
+  Stats.FramesDecoded = 0;
+  Stats.DecodeFailures = 0;
+  Stats.LastDecodeTime = 0;
+}
+
+
+ImageDecoder::~ImageDecoder()
+{
+}
+
+
+void ImageDecoder::Post(const QByteArray& data)
+{
+  QMutexLocker Lock(&Mutex);
+
+  if (Closed)
+    return;
+
+  if (!Pending.isEmpty())
+    Stats.FramesReplaced++;
+  Stats.FramesReceived++;
+  Pending = data;
+  DataArrived.wakeOne();
+}
+
+
+void ImageDecoder::Close()
+{
+  QMutexLocker Lock(&Mutex);
+
+  Closed = true;
+  Pending.clear();
+  DataArrived.wakeAll();
+}
+
+
+QImage ImageDecoder::GetImage()
+{
+  QMutexLocker Lock(&Mutex);
+
+  // The image data is shared, not copied
+  return Image;
+}
+
+
+ImageDecoder::Statistics ImageDecoder::GetStatistics()
+{
+  QMutexLocker Lock(&Mutex);
+
+  return Stats;
+}
+
+
+void ImageDecoder::run()
+{
+  QElapsedTimer Timer;
+
+  while (true)
+  {
+    QByteArray Data;
+
+    {
+      QMutexLocker Lock(&Mutex);
+
+      while (Pending.isEmpty() && !Closed)
+        DataArrived.wait(&Mutex);
+      if (Closed)
+        return;
+
+      Data = Pending;
+      Pending.clear();
+    }
+    QImage Decoded;
+
+    Timer.start();
+    const bool Success = Decoded.loadFromData((const uchar*)Data.constData(), Data.size(), "JPG");
+    QMutexLocker Lock(&Mutex);
+
+    if (!Success)
+    {
+      Stats.DecodeFailures++;
+      continue;
+    }
+    Image = Decoded;
+    Stats.FramesDecoded++;
+    Stats.LastDecodeTime = (float)Timer.nsecsElapsed() / 1000000;
+  }
+}
+
+
+ImageSocketWorker::ImageSocketWorker(const QString& host_name, ImageSender* sender, const QElapsedTimer& clock,
+                                     bool use_udp) :
+  QObject(), HostName(host_name), Sender(sender), Clock(clock), UseUdp(use_udp), Socket(NULL), UdpSocket(NULL),
+  Parser(MaxReceivedFrameSize), NextFrameId(0), StatisticsTimer(NULL), Connected(0), CurrentOffset(0), CurrentStart(0), NextStart(0),
+  WaitingForKeyframe(false)
+{
+  Stats.BytesSent = 0;
+  Stats.FramesSent = 0;
+  Stats.FramesReplaced = 0;
+  Stats.FramesDropped = 0;
+  Stats.BufferLevel = 0;
+  Stats.LastLatency = 0;
+  Stats.AverageLatency = 0;
+  Stats.MaxLatency = 0;
+  Stats.Encoding = ImageEncoder::Statistics();
+}
+
+
+ImageSocketWorker::~ImageSocketWorker()
+{
+}
+
+
+bool ImageSocketWorker::IsConnected() const
+{
+  return Connected.load() != 0;
+}
+
+
+ImageSocketWorker::Statistics ImageSocketWorker::GetStatistics()
+{
+  QMutexLocker Lock(&StatisticsMutex);
+
+  return Stats;
+}
+
+
+void ImageSocketWorker::Start()
+{
+  // The socket and the timer are created in the I/O thread to live in its event loop
+  StatisticsTimer = new QTimer(this);
+  connect(StatisticsTimer, SIGNAL(timeout()), this, SLOT(ReportStatistics()));
+  StatisticsTimer->start(StatisticsInterval);
+  if (UseUdp)
+  {
+    UdpSocket = new QUdpSocket(this);
+    UdpSocket->setSocketOption(QAbstractSocket::SendBufferSizeSocketOption, UdpSendBufferSize);
+    // There is no connection, the frames are sent from the start
+    Connected.store(1);
+    return;
+  }
+  Socket = new QTcpSocket(this);
+  connect(Socket, SIGNAL(readyRead()), this, SLOT(DataArrived()));
+  connect(Socket, SIGNAL(bytesWritten(qint64)), this, SLOT(WriteChunks()));
+  connect(Socket, SIGNAL(error(QAbstractSocket::SocketError)),
           this, SLOT(ErrorOccured(QAbstractSocket::SocketError)));
-  connect(this, SIGNAL(stateChanged(QAbstractSocket::SocketState)),
+  connect(Socket, SIGNAL(stateChanged(QAbstractSocket::SocketState)),
           this, SLOT(StateChanged(QAbstractSocket::SocketState)));
+  Connect();
 }
 
 
-ImageSender::~ImageSender()
+void ImageSocketWorker::Connect()
+{
+  if (Socket->state() != QAbstractSocket::UnconnectedState)
+    return;
+
+  Socket->connectToHost(QHostAddress(HostName), ImagePort);
+}
+
+
+void ImageSocketWorker::SendFrame(const QByteArray& data, qint64 encode_start)
+{
+  const bool Delta = IsDeltaMessage(data);
+
+  // The deltas after a lost frame refer to tiles the receiver never got
+  if (Delta && WaitingForKeyframe)
+  {
+    QMutexLocker Lock(&StatisticsMutex);
+
+    Stats.FramesDropped++;
+    return;
+  }
+  if (!Delta)
+    WaitingForKeyframe = false;
+  if (UdpSocket)
+  {
+    SendDatagrams(data, encode_start);
+    return;
+  }
+  if (Socket == NULL || Socket->state() != QAbstractSocket::ConnectedState)
+    return;
+
+  // Only the newest frame waits behind the one in progress
+  if (!NextPacket.isEmpty())
+  {
+    QMutexLocker Lock(&StatisticsMutex);
+
+    Stats.FramesDropped++;
+    // The tiles of a dropped delta frame are lost, the receiver needs a new keyframe
+    Sender->RequestKeyframe();
+    if (Delta)
+    {
+      Stats.FramesDropped++;
+      NextPacket.clear();
+      WaitingForKeyframe = true;
+      return;
+    }
+  }
+  NextPacket = data;
+  NextStart = encode_start;
+  WriteChunks();
+}
+
+
+void ImageSocketWorker::WriteChunks()
+{
+  if (Socket == NULL || Socket->state() != QAbstractSocket::ConnectedState)
+    return;
+
+  qint64 Written = 0;
+  int FramesCompleted = 0;
+  float Latency = -1;
+
+  // Keep at most a chunk in the write buffer of the socket, the rest is written when it drains
+  while (Socket->bytesToWrite() < ChunkSize)
+  {
+    if (CurrentPacket.isEmpty())
+    {
+      if (NextPacket.isEmpty())
+        break;
+
+      const quint32 Size = (quint32)NextPacket.size();
+
+      CurrentPacket = NextPacket;
+      CurrentOffset = 0;
+      CurrentStart = NextStart;
+      NextPacket.clear();
+      // Length prefix in big-endian byte order
+      CurrentHeader[0] = (char)((Size >> 24) & 0xFF);
+      CurrentHeader[1] = (char)((Size >> 16) & 0xFF);
+      CurrentHeader[2] = (char)((Size >> 8) & 0xFF);
+      CurrentHeader[3] = (char)(Size & 0xFF);
+    }
+    const int PacketSize = HeaderSize+CurrentPacket.size();
+    qint64 Result = 0;
+
+    // The shared JPEG data is not copied into a packet, the header is written separately
+    if (CurrentOffset < HeaderSize)
+      Result = Socket->write(CurrentHeader+CurrentOffset, HeaderSize-CurrentOffset);
+    else
+      Result = Socket->write(CurrentPacket.constData()+CurrentOffset-HeaderSize,
+                             qMin(ChunkSize, PacketSize-CurrentOffset));
+
+    if (Result <= 0)
+      break;
+
+    CurrentOffset += (int)Result;
+    Written += Result;
+    if (CurrentOffset >= PacketSize)
+    {
+      FramesCompleted++;
+      // The whole frame is in the socket buffer, the kernel may still hold it
+      Latency = (float)(Clock.nsecsElapsed()-CurrentStart) / 1000000;
+      CurrentPacket.clear();
+      CurrentOffset = 0;
+    }
+  }
+  QMutexLocker Lock(&StatisticsMutex);
+
+  Stats.BytesSent += Written;
+  Stats.FramesSent += FramesCompleted;
+  Stats.BufferLevel = Socket->bytesToWrite()+NextPacket.size();
+  if (!CurrentPacket.isEmpty())
+    Stats.BufferLevel += HeaderSize+CurrentPacket.size()-CurrentOffset;
+  if (Latency >= 0)
+    UpdateLatency(Latency, Stats.FramesSent == FramesCompleted);
+}
+
+
+void ImageSocketWorker::SendDatagrams(const QByteArray& data, qint64 encode_start)
+{
+  const int Count = Fragmenter.Fragment(data, NextFrameId++, UdpFragmenter::GetTimestamp());
+  const QHostAddress Address(HostName);
+  qint64 Written = 0;
+
+  // The whole frame goes out at once, a lost or refused datagram loses the frame
+  for (int i = 0; i < Count; ++i)
+  {
+    const qint64 Result = UdpSocket->writeDatagram(Fragmenter.GetDatagram(i), Fragmenter.GetDatagramSize(i),
+                                                   Address, ImagePort);
+
+    if (Result < 0)
+    {
+      QMutexLocker Lock(&StatisticsMutex);
+
+      Stats.BytesSent += Written;
+      Stats.FramesDropped++;
+      // The tiles of a dropped delta frame are lost, the next keyframe heals the receiver
+      Sender->RequestKeyframe();
+      WaitingForKeyframe = true;
+      return;
+    }
+    Written += Result;
+  }
+  QMutexLocker Lock(&StatisticsMutex);
+
+  Stats.BytesSent += Written;
+  Stats.FramesSent++;
+  Stats.BufferLevel = 0;
+  UpdateLatency((float)(Clock.nsecsElapsed()-encode_start) / 1000000, Stats.FramesSent == 1);
+}
+
+
+void ImageSocketWorker::UpdateLatency(float latency, bool first_frame)
+{
+  // The statistics mutex is held by the caller
+  Stats.AverageLatency = first_frame ? latency : Stats.AverageLatency*0.9+latency*0.1;
+  Stats.LastLatency = latency;
+  Stats.MaxLatency = std::max(Stats.MaxLatency, latency);
+}
+
+
+void ImageSocketWorker::ReportStatistics()
 {
-  disconnect(this, SIGNAL(readyRead()), this, SLOT(DataArrived()));
-  disconnect(this, SIGNAL(error(QAbstractSocket::SocketError)));
+  Statistics Current = Sender->GetStatistics();
+
+  printf("Image stream: %lld bytes sent, %d frames sent, %d replaced, %d dropped, %lld bytes buffered\n",
+         (long long)Current.BytesSent, Current.FramesSent, Current.FramesReplaced, Current.FramesDropped,
+         (long long)Current.BufferLevel);
+  printf("Image stream encode-to-socket latency: %1.2f ms (average), %1.2f ms (max)\n", Current.AverageLatency,
+         Current.MaxLatency);
+  printf("Image stream encoding: quality %d, %d bytes (last), %1.0f bytes (average), %1.2f ms (last), %1.2f ms (average)\n",
+         Current.Encoding.Quality, Current.Encoding.LastFrameSize, Current.Encoding.AverageFrameSize,
+         Current.Encoding.LastEncodeTime, Current.Encoding.AverageEncodeTime);
+  printf("Image stream tiles: %d keyframes, %1.1f tiles/frame (average)\n", Current.Encoding.Keyframes,
+         Current.Encoding.AverageTiles);
+  printf("Image stream received: %d frames, %d replaced, %d decoded, %d failed, %1.2f ms decoding (last)\n",
+         Current.Decoding.FramesReceived, Current.Decoding.FramesReplaced, Current.Decoding.FramesDecoded,
+         Current.Decoding.DecodeFailures, Current.Decoding.LastDecodeTime);
 }
 
 
-void ImageSender::DataArrived()
+void ImageSocketWorker::DataArrived()
 {
-  if (bytesAvailable() == 0)
+  const qint64 Available = Socket->bytesAvailable();
+
+  if (Available <= 0)
     return;
 
-  ImageData.resize(bytesAvailable());
-  printf("Read: %d bytes\n", (int)bytesAvailable());
-  readData((char*)&ImageData[0], bytesAvailable());
+  // The socket data is read into the buffer of the parser, frames may be partial or coalesced
+  const qint64 Result = Socket->read(Parser.PrepareWrite((int)Available), Available);
+
+  if (Result <= 0)
+    return;
+
+  QByteArray Frame;
+
+  Parser.CommitWrite((int)Result);
+  while (Parser.TakeFrame(Frame))
+    Sender->ReceiveFrame(Frame);
+  if (Parser.IsCorrupted())
+  {
+    printf("Invalid frame length from the wall pi, reconnecting\n");
+    Socket->abort();
+  }
 }
 
 
-void ImageSender::ErrorOccured(QAbstractSocket::SocketError error)
+void ImageSocketWorker::ErrorOccured(QAbstractSocket::SocketError error)
 {
   Q_UNUSED(error);
-  printf("TCP socket error: %s\n", qPrintable(errorString()));
+  printf("TCP socket error: %s\n", qPrintable(Socket->errorString()));
 }
 
-void ImageSender::StateChanged(QAbstractSocket::SocketState new_state)
+
+void ImageSocketWorker::StateChanged(QAbstractSocket::SocketState new_state)
 {
-  Q_UNUSED(new_state);
   printf("TCP state change: %d\n", new_state);
+  Connected.store(new_state == QAbstractSocket::ConnectedState ? 1 : 0);
+  // A new connection starts with a keyframe
+  if (new_state == QAbstractSocket::ConnectedState)
+  {
+    WaitingForKeyframe = true;
+    Sender->RequestKeyframe();
+  }
+  if (new_state != QAbstractSocket::UnconnectedState)
+    return;
+
+  // A partially sent or received frame can not be continued on a new connection
+  Parser.Reset();
+  CurrentPacket.clear();
+  CurrentOffset = 0;
+  NextPacket.clear();
+  {
+    QMutexLocker Lock(&StatisticsMutex);
+
+    Stats.BufferLevel = 0;
+  }
+  QTimer::singleShot(ReconnectDelay, this, SLOT(Connect()));
+}
+
+
+ImageSender::ImageSender(const QString& host_name, EncodedFrameCache& cache, int bytes_per_second,
+                         bool delta_tiles, bool use_udp) : QObject(), QQuickImageProvider(QQuickImageProvider::Image)
+{
+  qRegisterMetaType<QAbstractSocket::SocketError>("QAbstractSocket::SocketError");
+  qRegisterMetaType<QAbstractSocket::SocketState>("QAbstractSocket::SocketState");
+  Clock.start();
+  // The socket runs in a dedicated thread with its own event loop
+  SocketThread.reset(new QThread);
+  Worker.reset(new ImageSocketWorker(host_name, this, Clock, use_udp));
+  Worker->moveToThread(SocketThread.get());
+  connect(SocketThread.get(), SIGNAL(started()), Worker.get(), SLOT(Start()));
+  // The encoder takes the frames from the mailbox and passes the packets to the I/O thread
+  Encoder.reset(new ImageEncoder(Mailbox, cache, Clock, bytes_per_second, delta_tiles));
+  connect(Encoder.get(), SIGNAL(FrameEncoded(QByteArray, qint64)), Worker.get(), SLOT(SendFrame(QByteArray, qint64)));
+  // The worker requests keyframes from the encoder, both are created before the threads start
+  SocketThread->start();
+  Encoder->start();
+  Decoder.start();
+}
+
+
+ImageSender::~ImageSender()
+{
+  Mailbox.Close();
+  Encoder->wait();
+  SocketThread->quit();
+  SocketThread->wait();
+  Worker.reset();
+  Decoder.Close();
+  Decoder.wait();
 }
 
 
 QImage ImageSender::requestImage(const QString& id, QSize* size, const QSize& requested_size)
 {
   Q_UNUSED(id);
-  Q_UNUSED(size);
   Q_UNUSED(requested_size);
 
-  if (ImageData.size() > 0)
-  {
-    QImage Image;
-
-    Image.loadFromData((uchar*)&ImageData[0], ImageData.size(), "JPG");
+  // The image is decoded in the decoder thread already, the request does not block
+  QImage Image = Decoder.GetImage();
 
+  if (!Image.isNull())
+  {
     if (size)
       *size = QSize(Image.width(), Image.height());
 
-    ImageData.clear();
     return Image;
   }
   // Provide a grayscale image
-  QImage Image(640, 360, QImage::Format_RGB888);
+  QImage Placeholder(640, 360, QImage::Format_RGB888);
 
-  memset(Image.bits(), 100, 640*360*3);
-  return Image;
+  memset(Placeholder.bits(), 100, 640*360*3);
+  return Placeholder;
 }
 
 
-void ImageSender::SetImage(MEImage& image)
+void ImageSender::SendFrame(const FrameHandle& frame)
 {
-  QMutexLocker Lock(&ImageCopy);
+  // Do not encode while the wall pi is not connected
+  if (!Worker->IsConnected())
+    return;
 
-  *Image = image;
+  // A new frame replaces the one which has not been encoded yet
+  Mailbox.Post(frame);
 }
 
 
-void ImageSender::SendImage()
+ImageSocketWorker::Statistics ImageSender::GetStatistics()
 {
-  MC::BinaryDataSPtr ImageData;
+  ImageSocketWorker::Statistics Stats = Worker->GetStatistics();
 
-  {
-    QMutexLocker Lock(&ImageCopy);
+  Stats.FramesReplaced = Mailbox.GetReplacedCount();
+  Stats.Encoding = Encoder->GetStatistics();
+  Stats.Decoding = Decoder.GetStatistics();
+  return Stats;
+}
 
-// DISABLED: Too much performance hit
-//    if (Image->GetWidth() == 640 && Image->GetHeight() == 360)
-//      Calibration->Undistort(*Image);
 
-    ImageData.reset(Image->Compress());
-  }
-  // Use a chunk limit (laziness)
-  if (ImageData->GetSize() <= 65483)
-  {
-    QMutexLocker Lock(&SendMutex);
+void ImageSender::RequestKeyframe()
+{
+  Encoder->RequestKeyframe();
+}
 
-    writeData((char*)ImageData->GetData(), ImageData->GetSize());
-  }
+
+void ImageSender::ReceiveFrame(const QByteArray& data)
+{
+  // A new image replaces the one which has not been decoded yet
+  Decoder.Post(data);
 }
@@ -22,39 +22,211 @@
 #ifndef ImageSender_hpp
 #define ImageSender_hpp
 
+#include "FrameHandle.hpp"
+#include "FrameMailbox.hpp"
+#include "FrameStreamParser.hpp"
+#include "JpegRateController.hpp"
+#include "UdpFragmenter.hpp"
+
+#include <qatomic.h>
+#include <qbytearray.h>
+#include <qelapsedtimer.h>
+#include <qimage.h>
 #include <QMutexLocker>
 #include <qquickimageprovider.h>
 #include <qtcpsocket.h>
+#include <qthread.h>
+#include <qwaitcondition.h>
 
 #include <boost/scoped_ptr.hpp>
 
-#include <vector>
-
-class MECalibration;
+class EncodedFrameCache;
+class TileDeltaEncoder;
 class MEImage;
+class QTimer;
+class QUdpSocket;
+
+class ImageSender;
 
-class ImageSender : public QTcpSocket, public QQuickImageProvider
+/**
+ * Encoder thread of the image stream, it compresses always the newest frame of the mailbox.
+ *
+ * The JPEG quality is adjusted frame by frame to the byte rate budget of the link.
+ * In delta mode, keyframes and the changed tiles are sent (see TileDeltaEncoder).
+ */
+class ImageEncoder : public QThread
 {
   Q_OBJECT
 public:
-  ImageSender(const QString& host_name);
-  virtual ~ImageSender();
+  struct Statistics
+  {
+    int Quality;
+    int LastFrameSize;
+    float AverageFrameSize;
+    // Encoding times (ms)
+    float LastEncodeTime;
+    float AverageEncodeTime;
+    int Keyframes;
+    float AverageTiles;
+  };
+
+  ImageEncoder(FrameMailbox& mailbox, EncodedFrameCache& cache, const QElapsedTimer& clock, int bytes_per_second,
+               bool delta_tiles);
+  virtual ~ImageEncoder();
+
+  Statistics GetStatistics();
+  void RequestKeyframe();
+
+Q_SIGNALS:
+  void FrameEncoded(const QByteArray& data, qint64 encode_start);
+
+protected:
+  virtual void run();
+
+private:
+  FrameMailbox& Mailbox;
+  EncodedFrameCache& Cache;
+  const QElapsedTimer& Clock;
+  JpegRateController RateController;
+  boost::scoped_ptr<TileDeltaEncoder> DeltaEncoder;
+  Statistics Stats;
+  QMutex StatisticsMutex;
+};
+
+/**
+ * Decoder thread of the images coming back from the wall pi.
+ *
+ * It decodes always the newest received JPEG, the stale ones are replaced unseen.
+ * The last decoded image is published for the image requests, they never wait for a decoding.
+ */
+class ImageDecoder : public QThread
+{
+  Q_OBJECT
+public:
+  struct Statistics
+  {
+    int FramesReceived;
+    int FramesReplaced;
+    int FramesDecoded;
+    int DecodeFailures;
+    // Decoding time of the last image (ms)
+    float LastDecodeTime;
+  };
+
+  ImageDecoder();
+  virtual ~ImageDecoder();
+
+  void Post(const QByteArray& data);
+  void Close();
+  QImage GetImage();
+  Statistics GetStatistics();
+
+protected:
+  virtual void run();
+
+private:
+  QByteArray Pending;
+  bool Closed;
+  QImage Image;
+  Statistics Stats;
+  QMutex Mutex;
+  QWaitCondition DataArrived;
+};
+
+/**
+ * Network end of the image stream, it lives in the I/O thread of the sender.
+ *
+ * Every frame is written as a 4-byte big-endian length followed by the JPEG data.
+ * The frames are handed over to the socket in chunks as its write buffer drains,
+ * a frame is dropped when the previous one still waits behind the frame in progress.
+ *
+ * With the UDP transport, every frame is sent at once in datagrams (see UdpFragmenter),
+ * a frame is dropped when the send buffer of the socket is full.
+ */
+class ImageSocketWorker : public QObject
+{
+  Q_OBJECT
+public:
+  struct Statistics
+  {
+    qint64 BytesSent;
+    int FramesSent;
+    int FramesReplaced;
+    int FramesDropped;
+    qint64 BufferLevel;
+    // Latencies from the start of the encoding until the frame is written into the socket (ms)
+    float LastLatency;
+    float AverageLatency;
+    float MaxLatency;
+    ImageEncoder::Statistics Encoding;
+    ImageDecoder::Statistics Decoding;
+  };
+
+  ImageSocketWorker(const QString& host_name, ImageSender* sender, const QElapsedTimer& clock, bool use_udp);
+  virtual ~ImageSocketWorker();
+
+  bool IsConnected() const;
+  Statistics GetStatistics();
+
+public Q_SLOTS:
+  void Start();
+  void SendFrame(const QByteArray& data, qint64 encode_start);
 
 private Q_SLOTS:
+  void Connect();
   void DataArrived();
   void ErrorOccured(QAbstractSocket::SocketError error);
   void StateChanged(QAbstractSocket::SocketState new_state);
+  void WriteChunks();
+  void ReportStatistics();
+
+private:
+  void SendDatagrams(const QByteArray& data, qint64 encode_start);
+  void UpdateLatency(float latency, bool first_frame);
+
+  const QString HostName;
+  ImageSender* Sender;
+  const QElapsedTimer& Clock;
+  const bool UseUdp;
+  QTcpSocket* Socket;
+  QUdpSocket* UdpSocket;
+  FrameStreamParser Parser;
+  UdpFragmenter Fragmenter;
+  unsigned int NextFrameId;
+  QTimer* StatisticsTimer;
+  QAtomicInt Connected;
+  QByteArray CurrentPacket;
+  char CurrentHeader[4];
+  int CurrentOffset;
+  qint64 CurrentStart;
+  QByteArray NextPacket;
+  qint64 NextStart;
+  bool WaitingForKeyframe;
+  Statistics Stats;
+  QMutex StatisticsMutex;
+};
 
+class ImageSender : public QObject, public QQuickImageProvider
+{
+  Q_OBJECT
 public:
+  ImageSender(const QString& host_name, EncodedFrameCache& cache, int bytes_per_second, bool delta_tiles,
+              bool use_udp);
+  virtual ~ImageSender();
+
   virtual QImage requestImage(const QString& id, QSize* size, const QSize& requested_size);
-  void SetImage(MEImage& data);
-  void SendImage();
+  void SendFrame(const FrameHandle& frame);
+  ImageSocketWorker::Statistics GetStatistics();
+  void RequestKeyframe();
+  void ReceiveFrame(const QByteArray& data);
 
 private:
-  boost::scoped_ptr<MECalibration> Calibration;
-  std::vector<char> ImageData;
-  boost::scoped_ptr<MEImage> Image;
-  QMutex SendMutex, ImageCopy;
+  QElapsedTimer Clock;
+  FrameMailbox Mailbox;
+  boost::scoped_ptr<ImageEncoder> Encoder;
+  ImageDecoder Decoder;
+  boost::scoped_ptr<QThread> SocketThread;
+  boost::scoped_ptr<ImageSocketWorker> Worker;
 };
 
 #endif
@@ -0,0 +1,170 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "JpegEncoder.hpp"
+
+#include <MEImage.hpp>
+
+#include <MCLog.hpp>
+
+#include <csetjmp>
+#include <cstdio>
+#include <vector>
+
+#include <jpeglib.h>
+
+namespace
+{
+// Initial size of the output buffer, it grows when a frame does not fit
+const int InitialBufferSize = 64*1024;
+}
+
+struct JpegEncoderState
+{
+  struct ErrorManager
+  {
+    jpeg_error_mgr Base;
+    jmp_buf Jump;
+  };
+
+  jpeg_compress_struct Compressor;
+  ErrorManager Errors;
+  jpeg_destination_mgr Destination;
+  std::vector<JOCTET> Buffer;
+  std::vector<JSAMPROW> Rows;
+  size_t OutputSize;
+};
+
+namespace
+{
+void ErrorExit(j_common_ptr info)
+{
+  JpegEncoderState::ErrorManager* Errors = (JpegEncoderState::ErrorManager*)info->err;
+  char Message[JMSG_LENGTH_MAX];
+
+  (*info->err->format_message)(info, Message);
+  MC_LOG("JPEG compression failed: %s", Message);
+  longjmp(Errors->Jump, 1);
+}
+
+
+JpegEncoderState* GetState(j_compress_ptr info)
+{
+  return (JpegEncoderState*)info->client_data;
+}
+
+
+void InitDestination(j_compress_ptr info)
+{
+  JpegEncoderState* State = GetState(info);
+
+  State->Destination.next_output_byte = &State->Buffer[0];
+  State->Destination.free_in_buffer = State->Buffer.size();
+}
+
+
+boolean EmptyOutputBuffer(j_compress_ptr info)
+{
+  JpegEncoderState* State = GetState(info);
+  const size_t OldSize = State->Buffer.size();
+
+  // The whole buffer is full when libjpeg calls this function, keep it and double the size
+  State->Buffer.resize(OldSize*2);
+  State->Destination.next_output_byte = &State->Buffer[OldSize];
+  State->Destination.free_in_buffer = State->Buffer.size()-OldSize;
+  return TRUE;
+}
+
+
+void TermDestination(j_compress_ptr info)
+{
+  JpegEncoderState* State = GetState(info);
+
+  State->OutputSize = State->Buffer.size()-State->Destination.free_in_buffer;
+}
+}
+
+JpegEncoder::JpegEncoder() : State(new JpegEncoderState)
+{
+  State->Compressor.err = jpeg_std_error(&State->Errors.Base);
+  State->Errors.Base.error_exit = ErrorExit;
+  jpeg_create_compress(&State->Compressor);
+  State->Compressor.client_data = State.get();
+  State->Destination.init_destination = InitDestination;
+  State->Destination.empty_output_buffer = EmptyOutputBuffer;
+  State->Destination.term_destination = TermDestination;
+  State->Compressor.dest = &State->Destination;
+  State->Buffer.resize(InitialBufferSize);
+  State->OutputSize = 0;
+}
+
+
+JpegEncoder::~JpegEncoder()
+{
+  jpeg_destroy_compress(&State->Compressor);
+}
+
+
+bool JpegEncoder::Encode(const MEImage& image, int quality, QByteArray& output)
+{
+  const IplImage* Source = image.GetIplImage();
+
+  return Encode((const unsigned char*)Source->imageData, image.GetWidth(), image.GetHeight(), Source->widthStep,
+                image.GetLayers(), quality, output);
+}
+
+
+bool JpegEncoder::Encode(const unsigned char* data, int width, int height, int row_stride, int layers, int quality,
+                         QByteArray& output)
+{
+  jpeg_compress_struct& Compressor = State->Compressor;
+
+  if ((layers != 1 && layers != 3) || width <= 0 || height <= 0)
+    return false;
+
+  if (setjmp(State->Errors.Jump))
+  {
+    jpeg_abort_compress(&Compressor);
+    return false;
+  }
+  Compressor.image_width = width;
+  Compressor.image_height = height;
+  Compressor.input_components = layers;
+  Compressor.in_color_space = layers == 3 ? JCS_RGB : JCS_GRAYSCALE;
+  jpeg_set_defaults(&Compressor);
+  // The fast integer DCT has SIMD implementation in libjpeg-turbo
+  Compressor.dct_method = JDCT_IFAST;
+  jpeg_set_quality(&Compressor, quality, TRUE);
+  // Point the row pointers to the image rows without a copy
+  State->Rows.resize(height);
+  for (int y = 0; y < height; ++y)
+    State->Rows[y] = (JSAMPROW)(data+y*row_stride);
+
+  jpeg_start_compress(&Compressor, TRUE);
+  while (Compressor.next_scanline < Compressor.image_height)
+  {
+    jpeg_write_scanlines(&Compressor, &State->Rows[Compressor.next_scanline],
+                         Compressor.image_height-Compressor.next_scanline);
+  }
+  jpeg_finish_compress(&Compressor);
+  output = QByteArray((const char*)&State->Buffer[0], (int)State->OutputSize);
+  return true;
+}
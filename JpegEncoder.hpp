@@ -0,0 +1,53 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef JpegEncoder_hpp
+#define JpegEncoder_hpp
+
+#include <qbytearray.h>
+
+#include <boost/scoped_ptr.hpp>
+
+class MEImage;
+struct JpegEncoderState;
+
+/**
+ * JPEG encoder on libjpeg(-turbo) with a reusable compressor and output buffer.
+ *
+ * The compressor state, the row pointers and the output buffer are allocated once
+ * and reused for every frame. Grayscale and RGB images are supported, a region of
+ * an image can be compressed directly from its pixel buffer.
+ */
+class JpegEncoder
+{
+public:
+  JpegEncoder();
+  ~JpegEncoder();
+
+  bool Encode(const MEImage& image, int quality, QByteArray& output);
+  bool Encode(const unsigned char* data, int width, int height, int row_stride, int layers, int quality,
+              QByteArray& output);
+
+protected:
+  boost::scoped_ptr<JpegEncoderState> State;
+};
+
+#endif
@@ -0,0 +1,81 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "JpegRateController.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+const int InitialQuality = 75;
+// Initial frame interval (ms)
+const float InitialFrameInterval = 34;
+// Accepted deviation from the target size
+const float SizeTolerance = 0.1;
+// Quality change for a double or half sized frame
+const float QualityStep = 6;
+// Shortest accepted frame interval (ms)
+const int MinFrameInterval = 10;
+// Frame intervals above this (ms) are idle or dark periods
+const int MaxFrameInterval = 200;
+}
+
+JpegRateController::JpegRateController(int bytes_per_second, int min_quality, int max_quality) :
+  BytesPerSecond(bytes_per_second), MinQuality(min_quality), MaxQuality(max_quality),
+  Quality(std::min(std::max(InitialQuality, min_quality), max_quality)), FrameInterval(InitialFrameInterval),
+  TargetSize((int)(bytes_per_second*InitialFrameInterval / 1000))
+{
+}
+
+
+int JpegRateController::GetQuality() const
+{
+  return Quality;
+}
+
+
+int JpegRateController::GetTargetSize() const
+{
+  return TargetSize;
+}
+
+
+void JpegRateController::Update(int frame_size, int frame_interval)
+{
+  // The idle and dark periods are not part of the budget
+  if (frame_size <= 0 || frame_interval > MaxFrameInterval)
+    return;
+
+  FrameInterval = FrameInterval*0.8+std::max(frame_interval, MinFrameInterval)*0.2;
+  TargetSize = std::max((int)(BytesPerSecond*FrameInterval / 1000), 1);
+
+  const float Ratio = (float)frame_size / TargetSize;
+
+  if (Ratio < 1+SizeTolerance && Ratio > 1-SizeTolerance)
+    return;
+
+  int Step = (int)floor(QualityStep*std::log(Ratio) / std::log(2.0)+0.5);
+
+  if (Step == 0)
+    Step = Ratio > 1 ? 1 : -1;
+  Quality = std::min(std::max(Quality-Step, MinQuality), MaxQuality);
+}
@@ -0,0 +1,49 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef JpegRateController_hpp
+#define JpegRateController_hpp
+
+/**
+ * Adjusts the JPEG quality frame by frame to keep the stream in a byte rate budget.
+ *
+ * The size of a JPEG frame changes roughly exponentially with the quality, the
+ * controller steps the quality by the logarithm of the size/budget ratio.
+ */
+class JpegRateController
+{
+public:
+  JpegRateController(int bytes_per_second, int min_quality, int max_quality);
+
+  int GetQuality() const;
+  int GetTargetSize() const;
+  void Update(int frame_size, int frame_interval);
+
+protected:
+  const int BytesPerSecond;
+  const int MinQuality;
+  const int MaxQuality;
+  int Quality;
+  float FrameInterval;
+  int TargetSize;
+};
+
+#endif
@@ -0,0 +1,399 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "MotionDetector.hpp"
+
+#include <MEImage.hpp>
+
+#include <MCDefs.hpp>
+
+#include <opencv/cv.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include <algorithm>
+#include <string.h>
+
+namespace
+{
+const int MaxHistogramCount = 8;
+
+inline float Intersection(const float* histogram1, const float* histogram2)
+{
+#if defined(__SSE2__)
+  __m128 Sum = _mm_setzero_ps();
+  float Result[4];
+
+  for (int i = 0; i < MotionDetector::BinCount; i += 4)
+    Sum = _mm_add_ps(Sum, _mm_min_ps(_mm_loadu_ps(histogram1+i), _mm_loadu_ps(histogram2+i)));
+  _mm_storeu_ps(Result, Sum);
+  return Result[0]+Result[1]+Result[2]+Result[3];
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+  float32x4_t Sum = vdupq_n_f32(0);
+
+  for (int i = 0; i < MotionDetector::BinCount; i += 4)
+    Sum = vaddq_f32(Sum, vminq_f32(vld1q_f32(histogram1+i), vld1q_f32(histogram2+i)));
+  return vgetq_lane_f32(Sum, 0)+vgetq_lane_f32(Sum, 1)+vgetq_lane_f32(Sum, 2)+vgetq_lane_f32(Sum, 3);
+#else
+  float Sum = 0;
+
+  for (int i = 0; i < MotionDetector::BinCount; ++i)
+    Sum += std::min(histogram1[i], histogram2[i]);
+  return Sum;
+#endif
+}
+
+
+inline void AddCodes(const unsigned char* codes, int width, unsigned short* column_histograms)
+{
+  for (int x = 0; x < width; ++x)
+    column_histograms[x*MotionDetector::BinCount+codes[x]]++;
+}
+
+
+inline void RemoveCodes(const unsigned char* codes, int width, unsigned short* column_histograms)
+{
+  for (int x = 0; x < width; ++x)
+    column_histograms[x*MotionDetector::BinCount+codes[x]]--;
+}
+}
+
+MotionDetector::MotionDetector(int histograms_per_pixel) :
+  HistogramCount(MCBound(2, histograms_per_pixel, MaxHistogramCount)), BlockRadius(4), LBPThreshold(3),
+  HistogramLearningRate(0.01), WeightLearningRate(0.01), ProximityThreshold(0.65), BackgroundThreshold(0.4),
+  Width(0), Height(0), FrameCount(0), MotionPixelCount(0)
+{
+}
+
+
+MotionDetector::~MotionDetector()
+{
+}
+
+
+void MotionDetector::Reset()
+{
+  FrameCount = 0;
+  MotionPixelCount = 0;
+  std::fill(Mask.begin(), Mask.end(), 0);
+}
+
+
+void MotionDetector::DetectMotions(const MEImage& image)
+{
+  const IplImage* Image = image.GetIplImage();
+
+  if (Image->nChannels == 1)
+  {
+    DetectMotions((const unsigned char*)Image->imageData, Image->width, Image->height, Image->widthStep);
+    return;
+  }
+  // Convert the RGB image to grayscale
+  GrayData.resize(Image->width*Image->height);
+  for (int y = 0; y < Image->height; ++y)
+  {
+    const unsigned char* Row = (const unsigned char*)Image->imageData+y*Image->widthStep;
+    unsigned char* GrayRow = &GrayData[y*Image->width];
+
+    for (int x = 0; x < Image->width; ++x)
+    {
+      const unsigned char* Pixel = Row+x*Image->nChannels;
+
+      GrayRow[x] = (unsigned char)((77*Pixel[0]+150*Pixel[1]+29*Pixel[2]) >> 8);
+    }
+  }
+  DetectMotions(&GrayData[0], Image->width, Image->height, Image->width);
+}
+
+
+void MotionDetector::DetectMotions(const unsigned char* data, int width, int height, int row_width)
+{
+  if (width <= 0 || height <= 0)
+    return;
+
+  if (width != Width || height != Height)
+    Initialize(width, height);
+
+  CalculateLBPCodes(data, width, height, row_width, LBPThreshold, &Codes[0]);
+  MotionPixelCount = 0;
+  // Vertical window of the first row
+  std::fill(ColumnHistograms.begin(), ColumnHistograms.end(), 0);
+  for (int y = 0; y <= std::min(BlockRadius, height-1); ++y)
+    AddCodes(&Codes[y*width], width, &ColumnHistograms[0]);
+
+  for (int y = 0; y < height; ++y)
+  {
+    if (y > 0)
+    {
+      // Slide the vertical window
+      if (y+BlockRadius < height)
+        AddCodes(&Codes[(y+BlockRadius)*width], width, &ColumnHistograms[0]);
+      if (y-BlockRadius-1 >= 0)
+        RemoveCodes(&Codes[(y-BlockRadius-1)*width], width, &ColumnHistograms[0]);
+    }
+    const int RowCount = std::min(y+BlockRadius, height-1)-std::max(y-BlockRadius, 0)+1;
+    unsigned short Block[BinCount];
+
+    memset(Block, 0, sizeof(Block));
+    for (int x = 0; x <= std::min(BlockRadius, width-1); ++x)
+    {
+      for (int b = 0; b < BinCount; ++b)
+        Block[b] += ColumnHistograms[x*BinCount+b];
+    }
+    for (int x = 0; x < width; ++x)
+    {
+      if (x > 0)
+      {
+        // Slide the horizontal window
+        if (x+BlockRadius < width)
+        {
+          const unsigned short* Column = &ColumnHistograms[(x+BlockRadius)*BinCount];
+
+          for (int b = 0; b < BinCount; ++b)
+            Block[b] += Column[b];
+        }
+        if (x-BlockRadius-1 >= 0)
+        {
+          const unsigned short* Column = &ColumnHistograms[(x-BlockRadius-1)*BinCount];
+
+          for (int b = 0; b < BinCount; ++b)
+            Block[b] -= Column[b];
+        }
+      }
+      const int ColumnCount = std::min(x+BlockRadius, width-1)-std::max(x-BlockRadius, 0)+1;
+      const float Scale = 1.0f / (RowCount*ColumnCount);
+      float Histogram[BinCount];
+
+      for (int b = 0; b < BinCount; ++b)
+        Histogram[b] = Block[b]*Scale;
+      UpdatePixel(y*width+x, Histogram);
+    }
+  }
+  FrameCount++;
+}
+
+
+void MotionDetector::GetMotionsMask(MEImage& mask) const
+{
+  if (Width == 0 || Height == 0)
+    return;
+
+  if (mask.GetWidth() != Width || mask.GetHeight() != Height || mask.GetIplImage()->nChannels != 1)
+    mask = MEImage(Width, Height, 1);
+
+  IplImage* Mask = mask.GetIplImage();
+
+  for (int y = 0; y < Height; ++y)
+    memcpy(Mask->imageData+y*Mask->widthStep, &this->Mask[y*Width], Width);
+}
+
+
+float MotionDetector::GetMotionRatio() const
+{
+  if (Width == 0 || Height == 0)
+    return 0;
+
+  return (float)MotionPixelCount / (Width*Height);
+}
+
+
+void MotionDetector::SaveSnapshot(Snapshot& snapshot) const
+{
+  snapshot.Width = Width;
+  snapshot.Height = Height;
+  snapshot.FrameCount = FrameCount;
+  snapshot.ModelHistograms = ModelHistograms;
+  snapshot.ModelWeights = ModelWeights;
+}
+
+
+bool MotionDetector::RestoreSnapshot(const Snapshot& snapshot)
+{
+  // Restore only a learned model with the same layout
+  if (snapshot.FrameCount == 0 || snapshot.Width <= 0 || snapshot.Height <= 0 ||
+      (int)snapshot.ModelWeights.size() != HistogramCount*snapshot.Width*snapshot.Height ||
+      (int)snapshot.ModelHistograms.size() != HistogramCount*snapshot.Width*snapshot.Height*BinCount)
+    return false;
+
+  Initialize(snapshot.Width, snapshot.Height);
+  FrameCount = snapshot.FrameCount;
+  ModelHistograms = snapshot.ModelHistograms;
+  ModelWeights = snapshot.ModelWeights;
+  return true;
+}
+
+
+void MotionDetector::CalculateLBPCodes(const unsigned char* data, int width, int height, int row_width, int threshold,
+                                       unsigned char* codes)
+{
+  // The border pixels do not have all neighbours
+  memset(codes, 0, width);
+  memset(codes+(height-1)*width, 0, width);
+  for (int y = 1; y < height-1; ++y)
+  {
+    const unsigned char* Row = data+y*row_width;
+    unsigned char* CodeRow = codes+y*width;
+    int x = 1;
+
+    CodeRow[0] = 0;
+    CodeRow[width-1] = 0;
+#if defined(__SSE2__)
+    const __m128i Threshold = _mm_set1_epi8((char)threshold);
+
+    for (; x+16 <= width-1; x += 16)
+    {
+      const __m128i Center = _mm_loadu_si128((const __m128i*)(Row+x));
+      // Neighbour + threshold >= center
+      const __m128i North = _mm_adds_epu8(_mm_loadu_si128((const __m128i*)(Row+x-row_width)), Threshold);
+      const __m128i East = _mm_adds_epu8(_mm_loadu_si128((const __m128i*)(Row+x+1)), Threshold);
+      const __m128i South = _mm_adds_epu8(_mm_loadu_si128((const __m128i*)(Row+x+row_width)), Threshold);
+      const __m128i West = _mm_adds_epu8(_mm_loadu_si128((const __m128i*)(Row+x-1)), Threshold);
+      __m128i Code = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(North, Center), North), _mm_set1_epi8(1));
+
+      Code = _mm_or_si128(Code, _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(East, Center), East), _mm_set1_epi8(2)));
+      Code = _mm_or_si128(Code, _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(South, Center), South), _mm_set1_epi8(4)));
+      Code = _mm_or_si128(Code, _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(West, Center), West), _mm_set1_epi8(8)));
+      _mm_storeu_si128((__m128i*)(CodeRow+x), Code);
+    }
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    const uint8x16_t Threshold = vdupq_n_u8((unsigned char)threshold);
+
+    for (; x+16 <= width-1; x += 16)
+    {
+      const uint8x16_t Center = vld1q_u8(Row+x);
+      // Neighbour + threshold >= center
+      uint8x16_t Code = vandq_u8(vcgeq_u8(vqaddq_u8(vld1q_u8(Row+x-row_width), Threshold), Center), vdupq_n_u8(1));
+
+      Code = vorrq_u8(Code, vandq_u8(vcgeq_u8(vqaddq_u8(vld1q_u8(Row+x+1), Threshold), Center), vdupq_n_u8(2)));
+      Code = vorrq_u8(Code, vandq_u8(vcgeq_u8(vqaddq_u8(vld1q_u8(Row+x+row_width), Threshold), Center), vdupq_n_u8(4)));
+      Code = vorrq_u8(Code, vandq_u8(vcgeq_u8(vqaddq_u8(vld1q_u8(Row+x-1), Threshold), Center), vdupq_n_u8(8)));
+      vst1q_u8(CodeRow+x, Code);
+    }
+#endif
+    for (; x < width-1; ++x)
+    {
+      const int Center = Row[x]-threshold;
+
+      CodeRow[x] = (Row[x-row_width] >= Center ? 1 : 0) | (Row[x+1] >= Center ? 2 : 0) |
+                   (Row[x+row_width] >= Center ? 4 : 0) | (Row[x-1] >= Center ? 8 : 0);
+    }
+  }
+}
+
+
+void MotionDetector::Initialize(int width, int height)
+{
+  const int PixelCount = width*height;
+
+  Width = width;
+  Height = height;
+  FrameCount = 0;
+  MotionPixelCount = 0;
+  Codes.resize(PixelCount);
+  ColumnHistograms.resize(width*BinCount);
+  ModelHistograms.resize(HistogramCount*PixelCount*BinCount);
+  ModelWeights.resize(HistogramCount*PixelCount);
+  Mask.assign(PixelCount, 0);
+}
+
+
+void MotionDetector::UpdatePixel(int index, const float* histogram)
+{
+  const int PixelCount = Width*Height;
+  float* Models[MaxHistogramCount];
+  float* Weights[MaxHistogramCount];
+
+  for (int k = 0; k < HistogramCount; ++k)
+  {
+    Models[k] = &ModelHistograms[(k*PixelCount+index)*BinCount];
+    Weights[k] = &ModelWeights[k*PixelCount+index];
+  }
+  // The first histogram is the initial model
+  if (FrameCount == 0)
+  {
+    memcpy(Models[0], histogram, BinCount*sizeof(float));
+    *Weights[0] = 1;
+    for (int k = 1; k < HistogramCount; ++k)
+    {
+      memset(Models[k], 0, BinCount*sizeof(float));
+      *Weights[k] = 0;
+    }
+    Mask[index] = 0;
+    return;
+  }
+  float Proximities[MaxHistogramCount];
+  int Order[MaxHistogramCount];
+  int Best = 0;
+
+  for (int k = 0; k < HistogramCount; ++k)
+  {
+    Proximities[k] = Intersection(Models[k], histogram);
+    if (Proximities[k] > Proximities[Best])
+      Best = k;
+    // Sort the models by weight
+    int i = k;
+
+    for (; i > 0 && *Weights[Order[i-1]] < *Weights[k]; --i)
+      Order[i] = Order[i-1];
+    Order[i] = k;
+  }
+  // The heaviest models up to the background threshold describe the background
+  bool Background = false;
+  float CumulativeWeight = 0;
+
+  for (int i = 0; i < HistogramCount && !Background; ++i)
+  {
+    Background = Proximities[Order[i]] >= ProximityThreshold;
+    CumulativeWeight += *Weights[Order[i]];
+    if (CumulativeWeight > BackgroundThreshold)
+      break;
+  }
+  Mask[index] = Background ? 0 : 255;
+  if (!Background)
+    MotionPixelCount++;
+
+  // Update the models
+  float WeightSum = 0;
+
+  if (Proximities[Best] < ProximityThreshold)
+  {
+    // Replace the lightest model with the current histogram
+    const int Lightest = Order[HistogramCount-1];
+
+    memcpy(Models[Lightest], histogram, BinCount*sizeof(float));
+    *Weights[Lightest] = WeightLearningRate;
+  } else {
+    float* Model = Models[Best];
+
+    for (int b = 0; b < BinCount; ++b)
+      Model[b] += HistogramLearningRate*(histogram[b]-Model[b]);
+    for (int k = 0; k < HistogramCount; ++k)
+      *Weights[k] = (1-WeightLearningRate)*(*Weights[k])+(k == Best ? WeightLearningRate : 0);
+  }
+  for (int k = 0; k < HistogramCount; ++k)
+    WeightSum += *Weights[k];
+  for (int k = 0; k < HistogramCount; ++k)
+    *Weights[k] /= WeightSum;
+}
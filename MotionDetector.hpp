@@ -0,0 +1,95 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef MotionDetector_hpp
+#define MotionDetector_hpp
+
+#include <vector>
+
+class MEImage;
+
+/**
+ * Texture based motion detection with LBP histograms.
+ *
+ * Every pixel has a few weighted model histograms of the 4-neighbour LBP codes in
+ * a block around it (Heikkilä and Pietikäinen). The pixel is background when its
+ * current block histogram is close to one of the heaviest models. The block
+ * histograms are maintained with sliding column histograms and the model state is
+ * stored per plane (histograms and weights separately).
+ */
+class MotionDetector
+{
+public:
+  enum
+  {
+    BinCount = 16,
+  };
+
+  struct Snapshot
+  {
+    Snapshot() : Width(0), Height(0), FrameCount(0) {}
+
+    int Width;
+    int Height;
+    int FrameCount;
+    std::vector<float> ModelHistograms;
+    std::vector<float> ModelWeights;
+  };
+
+  MotionDetector(int histograms_per_pixel);
+  virtual ~MotionDetector();
+
+  void Reset();
+  void DetectMotions(const MEImage& image);
+  void DetectMotions(const unsigned char* data, int width, int height, int row_width);
+  void GetMotionsMask(MEImage& mask) const;
+  float GetMotionRatio() const;
+  void SaveSnapshot(Snapshot& snapshot) const;
+  bool RestoreSnapshot(const Snapshot& snapshot);
+
+  static void CalculateLBPCodes(const unsigned char* data, int width, int height, int row_width, int threshold,
+                                unsigned char* codes);
+
+private:
+  void Initialize(int width, int height);
+  void UpdatePixel(int index, const float* histogram);
+
+protected:
+  const int HistogramCount;
+  const int BlockRadius;
+  const int LBPThreshold;
+  const float HistogramLearningRate;
+  const float WeightLearningRate;
+  const float ProximityThreshold;
+  const float BackgroundThreshold;
+  int Width;
+  int Height;
+  int FrameCount;
+  int MotionPixelCount;
+  std::vector<unsigned char> GrayData;
+  std::vector<unsigned char> Codes;
+  std::vector<unsigned short> ColumnHistograms;
+  std::vector<float> ModelHistograms;
+  std::vector<float> ModelWeights;
+  std::vector<unsigned char> Mask;
+};
+
+#endif
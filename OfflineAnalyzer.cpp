@@ -0,0 +1,194 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "OfflineAnalyzer.hpp"
+
+#include <MECapture.hpp>
+#include <MEImage.hpp>
+
+#include <MCLog.hpp>
+
+#include <qelapsedtimer.h>
+#include <qlist.h>
+#include <QtConcurrentRun>
+#include <qthreadpool.h>
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+
+namespace
+{
+// Memory limit of the decoded luma frames of the segments in flight
+const qint64 MaxFrameMemory = 384*1024*1024;
+}
+
+OfflineAnalyzer::Segment::Segment() : FirstFrame(0), WarmUpCount(0)
+{
+}
+
+
+OfflineAnalyzer::OfflineAnalyzer(const QString& video_file, const QString& output_file) : VideoFile(video_file),
+  OutputFile(output_file), FrameWidth(320), FrameHeight(180), SegmentLength(900), WarmUpLength(300), Output(NULL)
+{
+}
+
+
+OfflineAnalyzer::~OfflineAnalyzer()
+{
+  if (Output)
+    fclose(Output);
+}
+
+
+bool OfflineAnalyzer::Run()
+{
+  Output = fopen(qPrintable(OutputFile), "w");
+  if (!Output)
+  {
+    MC_LOG("Unable to open the output file: %s", qPrintable(OutputFile));
+    return false;
+  }
+  fprintf(Output, "frame,brightness,event,table,tl_x,tl_y,tr_x,tr_y,bl_x,bl_y,br_x,br_y,motion_ratio\n");
+
+  MECapture CaptureDevice;
+  MEImage CapturedImage;
+  QList<QFuture<SegmentResults> > Tasks;
+  // Every segment in flight and the one being decoded hold this many frames at most
+  const qint64 SegmentMemory = (qint64)FrameWidth*FrameHeight*(SegmentLength+WarmUpLength);
+  const int MaxTasks = std::max(1, std::min(QThreadPool::globalInstance()->maxThreadCount(),
+                                            (int)(MaxFrameMemory / SegmentMemory)-1));
+  SegmentSPtr CurrentSegment(new Segment);
+  QElapsedTimer Timer;
+  int FrameIndex = 0;
+  bool LightsOff = false;
+
+  Timer.start();
+  CaptureDevice.Start(VideoFile.toStdString());
+  CaptureDevice.SetPlaybackFPS(1000);
+  // Decode the video file in this thread
+  while (CaptureDevice.IsCapturing() && CaptureDevice.CaptureFrame(CapturedImage))
+  {
+    const float Brightness = FrameAnalyzer::SampleBrightness(CapturedImage);
+    // Skip the same frames as the live pipeline, the lights off state follows the analysed frames
+    const bool Analysed = FrameIndex % 3 != 0 || LightsOff;
+    ME::ImageSPtr Luma;
+
+    if (Analysed)
+      LightsOff = FrameAnalyzer::IsDark(Brightness);
+    // The frames in the dark are not processed, only their brightness is needed
+    if (Analysed && !LightsOff)
+    {
+      Luma.reset(new MEImage);
+      FrameAnalyzer::ConvertToLuma(CapturedImage, FrameWidth, FrameHeight, *Luma);
+    }
+    CurrentSegment->Frames.push_back(Luma);
+    CurrentSegment->Brightness.push_back(Brightness);
+    CurrentSegment->Analysed.push_back(Analysed);
+    FrameIndex++;
+    if ((int)CurrentSegment->Frames.size()-CurrentSegment->WarmUpCount < SegmentLength)
+      continue;
+
+    // Keep the number of the decoded frames in the memory limited
+    if (Tasks.size() >= MaxTasks)
+    {
+      WriteResults(Tasks.first().result());
+      Tasks.removeFirst();
+    }
+    Tasks.append(QtConcurrent::run(boost::bind(&OfflineAnalyzer::AnalyzeSegment, CurrentSegment,
+                                               FrameWidth, FrameHeight)));
+    // The next segment starts with the last frames of this segment (shared, not copied)
+    SegmentSPtr NextSegment(new Segment);
+    const int WarmUpStart = (int)CurrentSegment->Frames.size()-WarmUpLength;
+
+    NextSegment->FirstFrame = CurrentSegment->FirstFrame+WarmUpStart;
+    NextSegment->WarmUpCount = WarmUpLength;
+    NextSegment->Frames.assign(CurrentSegment->Frames.begin()+WarmUpStart, CurrentSegment->Frames.end());
+    NextSegment->Brightness.assign(CurrentSegment->Brightness.begin()+WarmUpStart, CurrentSegment->Brightness.end());
+    NextSegment->Analysed.assign(CurrentSegment->Analysed.begin()+WarmUpStart, CurrentSegment->Analysed.end());
+    CurrentSegment = NextSegment;
+  }
+  if ((int)CurrentSegment->Frames.size() > CurrentSegment->WarmUpCount)
+  {
+    Tasks.append(QtConcurrent::run(boost::bind(&OfflineAnalyzer::AnalyzeSegment, CurrentSegment,
+                                               FrameWidth, FrameHeight)));
+  }
+  CurrentSegment.reset();
+  while (!Tasks.isEmpty())
+  {
+    WriteResults(Tasks.first().result());
+    Tasks.removeFirst();
+  }
+  fclose(Output);
+  Output = NULL;
+  MC_LOG("Offline analysis of %d frames: %1.2f s (%1.2f fps)", FrameIndex, (float)Timer.elapsed() / 1000,
+         Timer.elapsed() > 0 ? (float)FrameIndex*1000 / Timer.elapsed() : 0);
+  return true;
+}
+
+
+OfflineAnalyzer::SegmentResults OfflineAnalyzer::AnalyzeSegment(SegmentSPtr segment, int frame_width, int frame_height)
+{
+  FrameAnalyzer Analyzer(frame_width, frame_height, false);
+  // The analyzer does not touch the frames in the dark
+  const MEImage DarkFrame;
+  SegmentResults Results;
+  AnalysedFrame Frame;
+
+  Results.reserve(segment->Frames.size()-segment->WarmUpCount);
+  for (int i = 0; i < (int)segment->Frames.size(); ++i)
+  {
+    if (!segment->Analysed[i])
+      continue;
+
+    Analyzer.Analyze(segment->Frames[i] ? *segment->Frames[i] : DarkFrame, segment->Brightness[i], Frame.Result);
+    if (i >= segment->WarmUpCount)
+    {
+      Frame.Index = segment->FirstFrame+i;
+      Results.push_back(Frame);
+    }
+  }
+  return Results;
+}
+
+
+void OfflineAnalyzer::WriteResults(const SegmentResults& results)
+{
+  if (results.empty())
+    return;
+
+  for (int i = 0; i < (int)results.size(); ++i)
+  {
+    const FrameResult& Result = results[i].Result;
+    const char* Event = Result.Dark ? "idle" : (Result.MissingCorners ? "missing_corners" : "normal");
+
+    fprintf(Output, "%d,%1.2f,%s,%d", results[i].Index, Result.Brightness, Event, Result.TableDetected ? 1 : 0);
+    for (int c = 0; c < 4; ++c)
+    {
+      if (Result.TableDetected)
+        fprintf(Output, ",%d,%d", Result.Corners[c].X, Result.Corners[c].Y);
+      else
+        fprintf(Output, ",-1,-1");
+    }
+    fprintf(Output, ",%1.4f\n", Result.MotionRatio);
+  }
+  MC_LOG("Frames %d-%d analysed", results.front().Index, results.back().Index);
+}
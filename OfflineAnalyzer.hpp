@@ -0,0 +1,92 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef OfflineAnalyzer_hpp
+#define OfflineAnalyzer_hpp
+
+#include "FrameAnalyzer.hpp"
+
+#include <MEDefs.hpp>
+
+#include <qstring.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <stdio.h>
+#include <vector>
+
+/**
+ * Fast analysis of recorded matches on all processor cores.
+ *
+ * A single decoder reads the video file and prepares the luma planes. The
+ * frames are split into segments which are analysed on the thread pool with
+ * their own frame analyzers. Every segment starts with the last frames of the
+ * previous segment to warm up the marker and motion states, and the results
+ * of these frames are dropped. The same frames are analysed as in the live
+ * pipeline (every third frame is skipped unless the lights are off), and only
+ * the luma planes of these frames are kept. The number of the segments in
+ * flight is limited by a memory budget. The per-frame results are written in
+ * order into a CSV file; it has only the video events, the audio analysis
+ * runs on the live input only.
+ */
+class OfflineAnalyzer
+{
+public:
+  OfflineAnalyzer(const QString& video_file, const QString& output_file);
+  ~OfflineAnalyzer();
+
+  bool Run();
+
+private:
+  struct Segment
+  {
+    Segment();
+
+    int FirstFrame;
+    int WarmUpCount;
+    std::vector<ME::ImageSPtr> Frames;
+    std::vector<float> Brightness;
+    std::vector<bool> Analysed;
+  };
+
+  struct AnalysedFrame
+  {
+    int Index;
+    FrameResult Result;
+  };
+
+  typedef boost::shared_ptr<Segment> SegmentSPtr;
+  typedef std::vector<AnalysedFrame> SegmentResults;
+
+  static SegmentResults AnalyzeSegment(SegmentSPtr segment, int frame_width, int frame_height);
+  void WriteResults(const SegmentResults& results);
+
+protected:
+  const QString VideoFile;
+  const QString OutputFile;
+  const int FrameWidth;
+  const int FrameHeight;
+  const int SegmentLength;
+  const int WarmUpLength;
+  FILE* Output;
+};
+
+#endif
@@ -0,0 +1,241 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "OverlayLayer.hpp"
+
+#include <MEImage.hpp>
+
+#include <opencv/cv.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+OverlayLayer::Primitive::Primitive(PrimitiveType type, const MEColor& color, bool cached) : Type(type),
+  X1(0), Y1(0), X2(0), Y2(0), Radius(0), Size(0), Color(color), Cached(cached), PatchX(0), PatchY(0)
+{
+}
+
+
+OverlayLayer::OverlayLayer(float scale) : Scale(scale)
+{
+}
+
+
+void OverlayLayer::Clear()
+{
+  std::vector<Primitive> CachedPrimitives;
+
+  for (unsigned int i = 0; i < Primitives.size(); ++i)
+  {
+    if (Primitives[i].Cached)
+      CachedPrimitives.push_back(Primitives[i]);
+  }
+  Primitives.swap(CachedPrimitives);
+}
+
+
+void OverlayLayer::ClearCached()
+{
+  Primitives.clear();
+}
+
+
+bool OverlayLayer::IsEmpty() const
+{
+  return Primitives.empty();
+}
+
+
+void OverlayLayer::AddText(int x, int y, const std::string& text, float size, const MEColor& color, bool cached)
+{
+  Primitive Text(TextPrimitive, color, cached);
+
+  Text.X1 = x;
+  Text.Y1 = y;
+  Text.Text = text;
+  Text.Size = size;
+  Primitives.push_back(Text);
+}
+
+
+void OverlayLayer::AddRectangle(int x1, int y1, int x2, int y2, const MEColor& color, bool cached)
+{
+  Primitive Rectangle(RectanglePrimitive, color, cached);
+
+  Rectangle.X1 = x1;
+  Rectangle.Y1 = y1;
+  Rectangle.X2 = x2;
+  Rectangle.Y2 = y2;
+  Primitives.push_back(Rectangle);
+}
+
+
+void OverlayLayer::AddCircle(int x, int y, int radius, const MEColor& color, bool cached)
+{
+  Primitive Circle(CirclePrimitive, color, cached);
+
+  Circle.X1 = x;
+  Circle.Y1 = y;
+  Circle.Radius = radius;
+  Primitives.push_back(Circle);
+}
+
+
+void OverlayLayer::AddLine(int x1, int y1, int x2, int y2, const MEColor& color, bool cached)
+{
+  Primitive Line(LinePrimitive, color, cached);
+
+  Line.X1 = x1;
+  Line.Y1 = y1;
+  Line.X2 = x2;
+  Line.Y2 = y2;
+  Primitives.push_back(Line);
+}
+
+
+void OverlayLayer::Composite(MEImage& image)
+{
+  for (unsigned int i = 0; i < Primitives.size(); ++i)
+  {
+    Primitive& Item = Primitives[i];
+
+    if (!Item.Cached)
+    {
+      Draw(Item, image, 0, 0);
+      continue;
+    }
+    if (!Item.Patch.get() || Item.Patch->GetLayers() != image.GetLayers())
+      Rasterize(Item, image.GetLayers());
+    CopyPatch(*Item.Patch, Item.PatchX, Item.PatchY, image);
+  }
+}
+
+
+void OverlayLayer::Draw(const Primitive& primitive, MEImage& image, int offset_x, int offset_y) const
+{
+  const int X1 = (int)(primitive.X1*Scale+0.5)-offset_x;
+  const int Y1 = (int)(primitive.Y1*Scale+0.5)-offset_y;
+  const int X2 = (int)(primitive.X2*Scale+0.5)-offset_x;
+  const int Y2 = (int)(primitive.Y2*Scale+0.5)-offset_y;
+
+  switch (primitive.Type)
+  {
+    case TextPrimitive:
+      image.DrawText(X1, Y1, primitive.Text, primitive.Size, primitive.Color);
+      break;
+    case RectanglePrimitive:
+      image.DrawRectangle(X1, Y1, X2, Y2, primitive.Color, false);
+      break;
+    case CirclePrimitive:
+      image.DrawCircle(X1, Y1, (int)(primitive.Radius*Scale+0.5), primitive.Color);
+      break;
+    case LinePrimitive:
+      image.DrawLine(X1, Y1, X2, Y2, primitive.Color);
+      break;
+  }
+}
+
+
+void OverlayLayer::GetBoundingBox(const Primitive& primitive, int& x1, int& y1, int& x2, int& y2) const
+{
+  const int X1 = (int)(primitive.X1*Scale+0.5);
+  const int Y1 = (int)(primitive.Y1*Scale+0.5);
+  const int X2 = (int)(primitive.X2*Scale+0.5);
+  const int Y2 = (int)(primitive.Y2*Scale+0.5);
+
+  switch (primitive.Type)
+  {
+    case TextPrimitive:
+    {
+      // Generous estimation of the Hershey font extents from the text origin (bottom left)
+      const int Width = (int)(primitive.Size*24*primitive.Text.size())+8;
+
+      x1 = X1-4;
+      y1 = Y1-(int)(primitive.Size*32)-4;
+      x2 = X1+Width;
+      y2 = Y1+(int)(primitive.Size*12)+4;
+      break;
+    }
+    case CirclePrimitive:
+    {
+      const int Radius = (int)(primitive.Radius*Scale+0.5)+2;
+
+      x1 = X1-Radius;
+      y1 = Y1-Radius;
+      x2 = X1+Radius;
+      y2 = Y1+Radius;
+      break;
+    }
+    default:
+      x1 = std::min(X1, X2)-2;
+      y1 = std::min(Y1, Y2)-2;
+      x2 = std::max(X1, X2)+2;
+      y2 = std::max(Y1, Y2)+2;
+      break;
+  }
+}
+
+
+void OverlayLayer::Rasterize(Primitive& primitive, int layers)
+{
+  int X1, Y1, X2, Y2;
+
+  GetBoundingBox(primitive, X1, Y1, X2, Y2);
+  primitive.Patch.reset(new MEImage(X2-X1+1, Y2-Y1+1, layers));
+  primitive.Patch->Clear();
+  primitive.PatchX = X1;
+  primitive.PatchY = Y1;
+  Draw(primitive, *primitive.Patch, X1, Y1);
+}
+
+
+void OverlayLayer::CopyPatch(const MEImage& patch, int x, int y, MEImage& image)
+{
+  const IplImage* Source = patch.GetIplImage();
+  IplImage* Target = image.GetIplImage();
+  const int Channels = Source->nChannels;
+  const int StartX = std::max(0, -x);
+  const int StartY = std::max(0, -y);
+  const int EndX = std::min(Source->width, Target->width-x);
+  const int EndY = std::min(Source->height, Target->height-y);
+
+  if (Channels != Target->nChannels)
+    return;
+
+  for (int py = StartY; py < EndY; ++py)
+  {
+    const unsigned char* SourceRow = (const unsigned char*)Source->imageData+py*Source->widthStep;
+    unsigned char* TargetRow = (unsigned char*)Target->imageData+(y+py)*Target->widthStep+x*Channels;
+
+    for (int px = StartX; px < EndX; ++px)
+    {
+      const unsigned char* Pixel = SourceRow+px*Channels;
+      bool Drawn = false;
+
+      for (int c = 0; c < Channels; ++c)
+        Drawn |= (Pixel[c] != 0);
+      // Only the drawn pixels are copied like with the mask addition
+      if (Drawn)
+        memcpy(TargetRow+px*Channels, Pixel, Channels);
+    }
+  }
+}
@@ -0,0 +1,91 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef OverlayLayer_hpp
+#define OverlayLayer_hpp
+
+#include <MEDefs.hpp>
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+class MEImage;
+
+/**
+ * Recorded drawing primitives composited onto the output frames.
+ *
+ * The primitives are drawn directly onto the frame, so only their bounding
+ * rectangles are touched instead of blending a full-frame debug image. The
+ * cached primitives survive Clear() and they are rasterized only once into
+ * small patches which are copied onto the following frames.
+ */
+class OverlayLayer
+{
+public:
+  OverlayLayer(float scale);
+
+  void Clear();
+  void ClearCached();
+  bool IsEmpty() const;
+  void AddText(int x, int y, const std::string& text, float size, const MEColor& color, bool cached = false);
+  void AddRectangle(int x1, int y1, int x2, int y2, const MEColor& color, bool cached = false);
+  void AddCircle(int x, int y, int radius, const MEColor& color, bool cached = false);
+  void AddLine(int x1, int y1, int x2, int y2, const MEColor& color, bool cached = false);
+  void Composite(MEImage& image);
+
+private:
+  typedef enum
+  {
+    TextPrimitive = 0,
+    RectanglePrimitive,
+    CirclePrimitive,
+    LinePrimitive,
+  } PrimitiveType;
+
+  struct Primitive
+  {
+    Primitive(PrimitiveType type, const MEColor& color, bool cached);
+
+    PrimitiveType Type;
+    int X1, Y1, X2, Y2;
+    int Radius;
+    float Size;
+    std::string Text;
+    MEColor Color;
+    bool Cached;
+    // Rasterized cached primitive and its position in the frame
+    boost::shared_ptr<MEImage> Patch;
+    int PatchX, PatchY;
+  };
+
+  void Draw(const Primitive& primitive, MEImage& image, int offset_x, int offset_y) const;
+  void GetBoundingBox(const Primitive& primitive, int& x1, int& y1, int& x2, int& y2) const;
+  void Rasterize(Primitive& primitive, int layers);
+  static void CopyPatch(const MEImage& patch, int x, int y, MEImage& image);
+
+protected:
+  const float Scale;
+  std::vector<Primitive> Primitives;
+};
+
+#endif
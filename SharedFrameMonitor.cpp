@@ -0,0 +1,129 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "SharedFrameMonitor.hpp"
+
+#include <MCLog.hpp>
+
+#include <qelapsedtimer.h>
+
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace
+{
+// Period of the report (ms)
+const int ReportInterval = 5000;
+// Polling period of the ring (us)
+const int PollDelay = 1000;
+// Reattach to the ring after this long without new frames (ms)
+const int StallTimeout = 5000;
+}
+
+SharedFrameMonitor::SharedFrameMonitor(const QString& name) : Name(name)
+{
+}
+
+
+bool SharedFrameMonitor::Run()
+{
+  QElapsedTimer ReportTimer;
+  QElapsedTimer StallTimer;
+  uint64_t NextFrame = 0;
+  int FrameCount = 0;
+  int LostCount = 0;
+  int TornCount = 0;
+  long long ByteCount = 0;
+  double LatencySum = 0;
+  double MaxLatency = 0;
+  unsigned int Checksum = 0;
+
+  MC_LOG("Reading the shared frame ring %s", Name.toStdString().c_str());
+  ReportTimer.start();
+  StallTimer.start();
+  while (true)
+  {
+    if (!Reader.IsOpen() || StallTimer.elapsed() > StallTimeout)
+    {
+      // The ring exists only while the server runs
+      if (!Reader.Open(Name.toStdString()))
+      {
+        sleep(1);
+        continue;
+      }
+      NextFrame = 0;
+      StallTimer.start();
+    }
+    const uint64_t LastFrame = Reader.GetLastFrame();
+
+    if (LastFrame == 0 || LastFrame+1 == NextFrame)
+    {
+      usleep(PollDelay);
+    } else {
+      StallTimer.start();
+      if (NextFrame == 0)
+        NextFrame = LastFrame;
+      for (; NextFrame <= LastFrame; ++NextFrame)
+      {
+        SharedFrameView View;
+
+        if (!Reader.Acquire(NextFrame, View))
+        {
+          LostCount++;
+          continue;
+        }
+        // Touch the pixels in place like a consumer would
+        for (int i = 0; i < View.DataSize; i += 64)
+          Checksum += View.Data[i];
+        if (!Reader.Validate(View))
+        {
+          TornCount++;
+          continue;
+        }
+        const long long Delay = (long long)(SharedFrameWriter::GetTimestamp()-View.Metadata.Timestamp);
+        const double Latency = (double)Delay / 1000;
+
+        FrameCount++;
+        ByteCount += View.DataSize;
+        LatencySum += Latency;
+        MaxLatency = std::max(MaxLatency, Latency);
+      }
+    }
+    if (ReportTimer.elapsed() < ReportInterval)
+      continue;
+
+    const float Seconds = (float)ReportTimer.elapsed() / 1000;
+
+    MC_LOG("Shared frames: %1.2f fps, %1.0f bytes/s, %d lost, %d torn (checksum %u)", FrameCount / Seconds,
+           ByteCount / Seconds, LostCount, TornCount, Checksum);
+    MC_LOG("Shared frames latency: %1.2f ms (average), %1.2f ms (max)", FrameCount > 0 ? LatencySum / FrameCount : 0.0,
+           MaxLatency);
+    FrameCount = 0;
+    LostCount = 0;
+    TornCount = 0;
+    ByteCount = 0;
+    LatencySum = 0;
+    MaxLatency = 0;
+    ReportTimer.start();
+  }
+  return false;
+}
@@ -0,0 +1,48 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef SharedFrameMonitor_hpp
+#define SharedFrameMonitor_hpp
+
+#include "SharedFrameRing.hpp"
+
+#include <qstring.h>
+
+/**
+ * Test reader of the shared memory frame ring.
+ *
+ * It reads every frame in place and reports the frame rate, the frames lost
+ * because the reader was too slow, the torn reads and the latency from the
+ * capture time. It attaches again when the server restarts.
+ */
+class SharedFrameMonitor
+{
+public:
+  SharedFrameMonitor(const QString& name);
+
+  bool Run();
+
+protected:
+  const QString Name;
+  SharedFrameReader Reader;
+};
+
+#endif
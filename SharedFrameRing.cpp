@@ -0,0 +1,288 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "SharedFrameRing.hpp"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+namespace
+{
+// "IOPR" and the version of the layout
+const uint32_t RingMagic = 0x494F5052;
+const uint32_t RingVersion = 3;
+// The headers and the pixel data start on cache line boundaries
+const size_t CacheLineSize = 64;
+
+size_t AlignToCacheLine(size_t size)
+{
+  return (size+CacheLineSize-1) / CacheLineSize*CacheLineSize;
+}
+
+
+const size_t HeaderBytes = AlignToCacheLine(sizeof(SharedRingHeader));
+const size_t SlotHeaderBytes = AlignToCacheLine(sizeof(SharedSlotHeader));
+}
+
+SharedFrameWriter::SharedFrameWriter() : Segment(NULL), SegmentSize(0), LastFrame(0), SkippedCount(0)
+{
+}
+
+
+SharedFrameWriter::~SharedFrameWriter()
+{
+  Destroy();
+}
+
+
+bool SharedFrameWriter::Create(const std::string& name, int slot_count, int max_data_size)
+{
+  Destroy();
+  if (slot_count <= 0 || max_data_size <= 0)
+    return false;
+
+  const size_t SlotSize = AlignToCacheLine(SlotHeaderBytes+max_data_size);
+
+  // A segment left behind by a crashed writer is replaced, its readers keep the old mapping
+  shm_unlink(name.c_str());
+  const int Descriptor = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+
+  if (Descriptor < 0)
+    return false;
+
+  SegmentSize = HeaderBytes+SlotSize*slot_count;
+  if (ftruncate(Descriptor, SegmentSize) != 0)
+  {
+    close(Descriptor);
+    shm_unlink(name.c_str());
+    return false;
+  }
+  void* Memory = mmap(NULL, SegmentSize, PROT_READ | PROT_WRITE, MAP_SHARED, Descriptor, 0);
+
+  close(Descriptor);
+  if (Memory == MAP_FAILED)
+  {
+    shm_unlink(name.c_str());
+    return false;
+  }
+  Name = name;
+  Segment = (unsigned char*)Memory;
+  LastFrame = 0;
+  SkippedCount = 0;
+  // The new segment is zero-filled, the readers accept it when the magic number is set
+  SharedRingHeader* Header = (SharedRingHeader*)Segment;
+
+  Header->Version = RingVersion;
+  Header->SlotCount = (uint32_t)slot_count;
+  Header->SlotSize = (uint32_t)SlotSize;
+  Header->MaxDataSize = (uint32_t)max_data_size;
+  __atomic_store_n(&Header->Magic, RingMagic, __ATOMIC_RELEASE);
+  return true;
+}
+
+
+bool SharedFrameWriter::Publish(const unsigned char* data, int width, int height, int row_stride, int layers,
+                                const SharedFrameMetadata& metadata)
+{
+  if (!Segment)
+    return false;
+
+  SharedRingHeader* Header = (SharedRingHeader*)Segment;
+  const int RowSize = width*layers;
+
+  if (width <= 0 || height <= 0 || RowSize*height > (int)Header->MaxDataSize)
+  {
+    SkippedCount++;
+    return false;
+  }
+  const uint64_t FrameNumber = LastFrame+1;
+  unsigned char* SlotStart = Segment+HeaderBytes+(FrameNumber % Header->SlotCount)*Header->SlotSize;
+  SharedSlotHeader* Slot = (SharedSlotHeader*)SlotStart;
+  unsigned char* Target = SlotStart+SlotHeaderBytes;
+
+  // Odd sequence: the readers of the previous frame in the slot see the overwrite
+  __atomic_store_n(&Slot->Sequence, FrameNumber*2-1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  Slot->Metadata = metadata;
+  Slot->Metadata.FrameNumber = FrameNumber;
+  Slot->Width = (uint32_t)width;
+  Slot->Height = (uint32_t)height;
+  Slot->Layers = (uint32_t)layers;
+  Slot->DataSize = (uint32_t)(RowSize*height);
+  if (row_stride == RowSize)
+  {
+    memcpy(Target, data, RowSize*height);
+  } else {
+    for (int y = 0; y < height; ++y)
+      memcpy(Target+y*RowSize, data+y*row_stride, RowSize);
+  }
+  // Even sequence: the frame is complete
+  __atomic_store_n(&Slot->Sequence, FrameNumber*2, __ATOMIC_RELEASE);
+  __atomic_store_n(&Header->LastFrame, FrameNumber, __ATOMIC_RELEASE);
+  LastFrame = FrameNumber;
+  return true;
+}
+
+
+int SharedFrameWriter::GetSkippedCount() const
+{
+  return SkippedCount;
+}
+
+
+uint64_t SharedFrameWriter::GetTimestamp()
+{
+  timeval Now;
+
+  gettimeofday(&Now, NULL);
+  return (uint64_t)Now.tv_sec*1000000+Now.tv_usec;
+}
+
+
+void SharedFrameWriter::Destroy()
+{
+  if (!Segment)
+    return;
+
+  munmap(Segment, SegmentSize);
+  shm_unlink(Name.c_str());
+  Segment = NULL;
+  SegmentSize = 0;
+}
+
+
+SharedFrameReader::SharedFrameReader() : Segment(NULL), SegmentSize(0)
+{
+}
+
+
+SharedFrameReader::~SharedFrameReader()
+{
+  Close();
+}
+
+
+bool SharedFrameReader::Open(const std::string& name)
+{
+  Close();
+
+  const int Descriptor = shm_open(name.c_str(), O_RDONLY, 0);
+  struct stat Status;
+
+  if (Descriptor < 0)
+    return false;
+
+  if (fstat(Descriptor, &Status) != 0 || (size_t)Status.st_size < HeaderBytes)
+  {
+    close(Descriptor);
+    return false;
+  }
+  void* Memory = mmap(NULL, Status.st_size, PROT_READ, MAP_SHARED, Descriptor, 0);
+
+  close(Descriptor);
+  if (Memory == MAP_FAILED)
+    return false;
+
+  Segment = (const unsigned char*)Memory;
+  SegmentSize = Status.st_size;
+  // The layout fields are valid after the magic number
+  const SharedRingHeader* Header = (const SharedRingHeader*)Segment;
+
+  if (__atomic_load_n(&Header->Magic, __ATOMIC_ACQUIRE) != RingMagic || Header->Version != RingVersion ||
+      Header->SlotCount == 0 || Header->SlotSize < SlotHeaderBytes+Header->MaxDataSize ||
+      SegmentSize < HeaderBytes+(size_t)Header->SlotSize*Header->SlotCount)
+  {
+    Close();
+    return false;
+  }
+  return true;
+}
+
+
+void SharedFrameReader::Close()
+{
+  if (!Segment)
+    return;
+
+  munmap((void*)Segment, SegmentSize);
+  Segment = NULL;
+  SegmentSize = 0;
+}
+
+
+bool SharedFrameReader::IsOpen() const
+{
+  return Segment != NULL;
+}
+
+
+uint64_t SharedFrameReader::GetLastFrame() const
+{
+  if (!Segment)
+    return 0;
+
+  return __atomic_load_n(&((const SharedRingHeader*)Segment)->LastFrame, __ATOMIC_ACQUIRE);
+}
+
+
+bool SharedFrameReader::Acquire(uint64_t frame_number, SharedFrameView& view) const
+{
+  if (!Segment || frame_number == 0)
+    return false;
+
+  const SharedRingHeader* Header = (const SharedRingHeader*)Segment;
+  const unsigned char* SlotStart = Segment+HeaderBytes+(frame_number % Header->SlotCount)*Header->SlotSize;
+  const SharedSlotHeader* Slot = (const SharedSlotHeader*)SlotStart;
+
+  // The frame is being written or it has been overwritten already
+  view.Sequence = __atomic_load_n(&Slot->Sequence, __ATOMIC_ACQUIRE);
+  if (view.Sequence != frame_number*2)
+    return false;
+
+  view.Metadata = Slot->Metadata;
+  view.Width = (int)Slot->Width;
+  view.Height = (int)Slot->Height;
+  view.Layers = (int)Slot->Layers;
+  view.DataSize = (int)Slot->DataSize;
+  view.Data = SlotStart+SlotHeaderBytes;
+  // A torn size would point out of the slot
+  return view.DataSize >= 0 && view.DataSize <= (int)Header->MaxDataSize;
+}
+
+
+bool SharedFrameReader::Validate(const SharedFrameView& view) const
+{
+  if (!Segment || view.Sequence == 0)
+    return false;
+
+  const SharedRingHeader* Header = (const SharedRingHeader*)Segment;
+  const uint64_t FrameNumber = view.Sequence / 2;
+  const SharedSlotHeader* Slot = (const SharedSlotHeader*)(Segment+HeaderBytes+
+                                 (FrameNumber % Header->SlotCount)*Header->SlotSize);
+
+  // The reads of the frame complete before the sequence is checked again
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return __atomic_load_n(&Slot->Sequence, __ATOMIC_RELAXED) == view.Sequence;
+}
@@ -0,0 +1,163 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef SharedFrameRing_hpp
+#define SharedFrameRing_hpp
+
+#include <stdint.h>
+
+#include <string>
+
+/**
+ * Shared memory ring of the processed camera frames for the local consumers.
+ *
+ * The segment starts with a SharedRingHeader, followed by SlotCount slots. Every slot
+ * is a SharedSlotHeader and the pixel data of a frame (rows without padding). Frame n
+ * (counted from 1) is written into slot n % SlotCount.
+ *
+ * The slots are guarded by sequence counters: the sequence of a slot is 2n-1 while
+ * frame n is written and 2n when it is complete. A reader reads the sequence, uses the
+ * frame in place and checks the sequence again, the frame is valid only if it has not
+ * changed. The writer never waits for the readers, a slow reader loses frames.
+ *
+ * All coordinates of the metadata are in the pixels of the raw capture, which is
+ * the published frame unless DebugViewFlag is set.
+ */
+struct SharedFrameMetadata
+{
+  enum Flags
+  {
+    DarkFlag = 1,
+    IdleFlag = 2,
+    TableDetectedFlag = 4,
+    MissingCornersFlag = 8,
+    BallFlag = 16,
+    // The pixels are the corrected debug view, the coordinates still refer to the raw capture
+    DebugViewFlag = 32,
+    // The frame was not analysed, the analysis results are carried over from the last analysed frame
+    CarriedOverFlag = 64
+  };
+
+  uint64_t FrameNumber;
+  // Capture time (microseconds of the wall clock)
+  uint64_t Timestamp;
+  float Brightness;
+  // Ratio of the moving pixels on the table
+  float MotionRatio;
+  // Table corners (x, y) in the pixel coordinates of the raw capture (before the undistortion)
+  float Corners[8];
+  uint32_t Flags;
+  // Audio events since the previous frame (bit 1 << IOP::AudioEventType)
+  uint32_t Events;
+  // Ball position (x, y) measured on this frame in the coordinates of the raw capture, valid with BallFlag
+  float Ball[2];
+  // Capture time of this frame on the clock of the ball tracker (milliseconds since the start of the capture)
+  uint32_t BallTimestamp;
+  uint32_t Reserved;
+};
+
+struct SharedRingHeader
+{
+  uint32_t Magic;
+  uint32_t Version;
+  uint32_t SlotCount;
+  uint32_t SlotSize;
+  uint32_t MaxDataSize;
+  uint32_t Reserved;
+  // Number of the last complete frame, 0 before the first one
+  uint64_t LastFrame;
+};
+
+struct SharedSlotHeader
+{
+  uint64_t Sequence;
+  SharedFrameMetadata Metadata;
+  uint32_t Width;
+  uint32_t Height;
+  uint32_t Layers;
+  uint32_t DataSize;
+};
+
+/**
+ * Writer of the ring, the segment exists while the writer is alive.
+ */
+class SharedFrameWriter
+{
+public:
+  SharedFrameWriter();
+  ~SharedFrameWriter();
+
+  bool Create(const std::string& name, int slot_count, int max_data_size);
+  bool Publish(const unsigned char* data, int width, int height, int row_stride, int layers,
+               const SharedFrameMetadata& metadata);
+  int GetSkippedCount() const;
+
+  static uint64_t GetTimestamp();
+
+protected:
+  void Destroy();
+
+  std::string Name;
+  unsigned char* Segment;
+  size_t SegmentSize;
+  uint64_t LastFrame;
+  int SkippedCount;
+};
+
+/**
+ * Frame in the ring as seen by a reader.
+ *
+ * Data points into the shared memory, the frame is usable only if the reader
+ * validates it after the use.
+ */
+struct SharedFrameView
+{
+  SharedFrameMetadata Metadata;
+  int Width;
+  int Height;
+  int Layers;
+  int DataSize;
+  const unsigned char* Data;
+  uint64_t Sequence;
+};
+
+/**
+ * Lock-free reader of the ring, any number of readers can attach to the same segment.
+ */
+class SharedFrameReader
+{
+public:
+  SharedFrameReader();
+  ~SharedFrameReader();
+
+  bool Open(const std::string& name);
+  void Close();
+  bool IsOpen() const;
+  uint64_t GetLastFrame() const;
+  bool Acquire(uint64_t frame_number, SharedFrameView& view) const;
+  bool Validate(const SharedFrameView& view) const;
+
+protected:
+  const unsigned char* Segment;
+  size_t SegmentSize;
+};
+
+#endif
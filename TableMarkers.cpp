@@ -21,24 +21,26 @@
 
 #include "TableMarkers.hpp"
 
+#include "CornerAccumulator.hpp"
+#include "CornerFinder.hpp"
+#include "OverlayLayer.hpp"
+
 #include <MEImage.hpp>
 
 #include <MCLog.hpp>
-#include <MCSampleStatistics.hpp>
 
 #include <opencv/cv.h>
 
-TableMarkers::TableMarkers(int image_width, int image_height) : ImageWidth(image_width),
-  ImageHeight(image_height), FrameLimit(60), CornerSampleCount(40),
-  CornerRegionWidth(ImageWidth / 4), CornerRegionHeight(ImageHeight / 3), RegionGap(5), FrameCount(0),
-  Corner1X(CornerSampleCount, *new MCArithmeticMean<int>("Mean")),
-  Corner1Y(CornerSampleCount, *new MCArithmeticMean<int>("Mean")),
-  Corner2X(CornerSampleCount, *new MCArithmeticMean<int>("Mean")),
-  Corner2Y(CornerSampleCount, *new MCArithmeticMean<int>("Mean")),
-  Corner3X(CornerSampleCount, *new MCArithmeticMean<int>("Mean")),
-  Corner3Y(CornerSampleCount, *new MCArithmeticMean<int>("Mean")),
-  Corner4X(CornerSampleCount, *new MCArithmeticMean<int>("Mean")),
-  Corner4Y(CornerSampleCount, *new MCArithmeticMean<int>("Mean"))
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+TableMarkers::TableMarkers(int image_width, int image_height, bool logging) : ImageWidth(image_width),
+  ImageHeight(image_height), Logging(logging), FrameLimit(60), MaxFrameLimit(2*FrameLimit), CornerSampleCount(40),
+  CornerRegionWidth(ImageWidth / 4), CornerRegionHeight(ImageHeight / 3), RegionGap(5),
+  TrackingInterval(30), TrackingWindowWidth(CornerRegionWidth / 3), TrackingWindowHeight(CornerRegionHeight / 3),
+  TrackingTolerance(6), TrackingMissLimit(3), LearningLimit(FrameLimit), FrameCount(0), Tracking(false), TrackingFrameCount(0),
+  Finder(new CornerFinder(logging)), Corners(new CornerAccumulator(CornerSampleCount, true))
 {
 }
 
@@ -50,71 +52,164 @@ TableMarkers::~TableMarkers()
 
 void TableMarkers::Reset()
 {
+  LearningLimit = FrameLimit;
   FrameCount = 0;
-  Corner1X.Reset();
-  Corner1Y.Reset();
-  Corner2X.Reset();
-  Corner2Y.Reset();
-  Corner3X.Reset();
-  Corner3Y.Reset();
-  Corner4X.Reset();
-  Corner4Y.Reset();
+  Tracking = false;
+  Corners->Reset();
 }
 
 
 void TableMarkers::AddImage(MEImage& image)
 {
-  if (FrameCount == FrameLimit)
-    return;
-
-  MEPoint Point1 = FindCorner(image, RegionGap, RegionGap, CornerRegionWidth, CornerRegionHeight);
-  MEPoint Point2 = FindCorner(image, image.GetWidth()-1-CornerRegionWidth, RegionGap, image.GetWidth()-1-RegionGap, CornerRegionHeight);
-  MEPoint Point3 = FindCorner(image, RegionGap, image.GetHeight()-1-CornerRegionHeight, CornerRegionWidth, image.GetHeight()-1-RegionGap);
-  MEPoint Point4 = FindCorner(image, image.GetWidth()-1-CornerRegionWidth, image.GetHeight()-1-CornerRegionHeight,
-                              image.GetWidth()-1-RegionGap, image.GetHeight()-1-RegionGap);
-
-  FrameCount++;
-  if (Point1.IsValid())
+  if (Tracking)
   {
-    Corner1X << Point1.X;
-    Corner1Y << Point1.Y;
-  }
-  if (Point2.IsValid())
-  {
-    Corner2X << Point2.X;
-    Corner2Y << Point2.Y;
-  }
-  if (Point3.IsValid())
-  {
-    Corner3X << Point3.X;
-    Corner3Y << Point3.Y;
+    // Check the corners only occasionally after the lock
+    if (++TrackingFrameCount % TrackingInterval == 0)
+      TrackCorners(image);
+    return;
   }
-  if (Point4.IsValid())
+  if (FrameCount == LearningLimit)
+    return;
+
+  Finder->SetImage(image);
+  for (int i = 0; i < 4; ++i)
   {
-    Corner4X << Point4.X;
-    Corner4Y << Point4.Y;
+    int X1, Y1, X2, Y2;
+
+    GetSearchRegion(i, X1, Y1, X2, Y2);
+    MEPoint Point = Finder->FindCorner(X1, Y1, X2, Y2);
+
+    if (!Point.IsValid())
+      continue;
+
+    const int MissingSamples = Corners->GetMissingSampleCount(i);
+
+    Corners->AddSample(i, Point.X, Point.Y);
+    // A restarted window is refilled before the learning ends
+    if (Corners->GetMissingSampleCount(i) > MissingSamples)
+      LearningLimit = std::min(MaxFrameLimit, std::max(LearningLimit,
+                               FrameCount+1+Corners->GetMissingSampleCount(i)));
   }
+  FrameCount++;
+  if (FrameCount == LearningLimit && !IsAnyMissingCorner())
+    StartTracking();
+}
+
+
+void TableMarkers::GetSearchRegion(int corner, int& x1, int& y1, int& x2, int& y2)
+{
+  // Top-left, top-right, bottom-left and bottom-right regions
+  x1 = (corner % 2 == 0) ? RegionGap : ImageWidth-1-CornerRegionWidth;
+  y1 = (corner < 2) ? RegionGap : ImageHeight-1-CornerRegionHeight;
+  x2 = (corner % 2 == 0) ? CornerRegionWidth : ImageWidth-1-RegionGap;
+  y2 = (corner < 2) ? CornerRegionHeight : ImageHeight-1-RegionGap;
 }
 
 
 bool TableMarkers::IsReady()
 {
-  return FrameCount >= FrameLimit;
+  return FrameCount >= LearningLimit;
+}
+
+
+bool TableMarkers::IsTracking()
+{
+  return Tracking;
 }
 
 
 bool TableMarkers::IsAnyMissingCorner()
 {
-  if (FrameCount < FrameLimit)
+  if (FrameCount < LearningLimit)
+    return false;
+
+  return !Corners->AreAllValid();
+}
+
+
+bool TableMarkers::GetTableCorners(MEPoint* corners)
+{
+  if (!IsReady() || IsAnyMissingCorner())
+    return false;
+
+  for (int i = 0; i < 4; ++i)
+    corners[i] = Corners->GetMean(i);
+  return true;
+}
+
+
+bool TableMarkers::GetTableRegion(int margin, int& x1, int& y1, int& x2, int& y2)
+{
+  MEPoint Corners[4];
+
+  if (!GetTableCorners(Corners))
+    return false;
+
+  const int RegionX1 = MCBound(0, std::min(Corners[0].X, Corners[2].X)-margin, ImageWidth-1);
+  const int RegionY1 = MCBound(0, std::min(Corners[0].Y, Corners[1].Y)-margin, ImageHeight-1);
+  const int RegionX2 = MCBound(0, std::max(Corners[1].X, Corners[3].X)+margin, ImageWidth-1);
+  const int RegionY2 = MCBound(0, std::max(Corners[2].Y, Corners[3].Y)+margin, ImageHeight-1);
+
+  if (RegionX2-RegionX1 <= 0 || RegionY2-RegionY1 <= 0)
     return false;
 
-  bool Ready = true;
+  x1 = RegionX1;
+  y1 = RegionY1;
+  x2 = RegionX2;
+  y2 = RegionY2;
+  return true;
+}
+
+
+void TableMarkers::CreateTableMask(int margin, int x1, int y1, int x2, int y2, MEImage& mask)
+{
+  unsigned char* MaskData = (unsigned char*)mask.GetIplImage()->imageData;
+  const int RowWidth = mask.GetIplImage()->widthStep;
+  MEPoint Corners[4];
+
+  if (!GetTableCorners(Corners))
+  {
+    memset(MaskData, 255, RowWidth*mask.GetHeight());
+    return;
+  }
+  // Table quadrilateral in clockwise order, pushed outwards by the margin
+  const int Order[4] = { 0, 1, 3, 2 };
+  const float CenterX = (float)(Corners[0].X+Corners[1].X+Corners[2].X+Corners[3].X) / 4;
+  const float CenterY = (float)(Corners[0].Y+Corners[1].Y+Corners[2].Y+Corners[3].Y) / 4;
+  float PolygonX[4];
+  float PolygonY[4];
+
+  for (int i = 0; i < 4; ++i)
+  {
+    const float DiffX = Corners[Order[i]].X-CenterX;
+    const float DiffY = Corners[Order[i]].Y-CenterY;
+    const float Length = std::max(sqrtf(DiffX*DiffX+DiffY*DiffY), 1.0f);
+
+    PolygonX[i] = Corners[Order[i]].X+DiffX / Length*margin;
+    PolygonY[i] = Corners[Order[i]].Y+DiffY / Length*margin;
+  }
+  // Map the mask pixels to the image region and test them against the quadrilateral
+  const float ScaleX = (float)(x2-x1) / mask.GetWidth();
+  const float ScaleY = (float)(y2-y1) / mask.GetHeight();
+
+  for (int y = 0; y < mask.GetHeight(); ++y)
+  {
+    const float PosY = y1+(y+0.5)*ScaleY;
+
+    for (int x = 0; x < mask.GetWidth(); ++x)
+    {
+      const float PosX = x1+(x+0.5)*ScaleX;
+      bool Inside = true;
 
-  Ready = Ready && Corner1X.IsValid() && Corner1Y.IsValid();
-  Ready = Ready && Corner2X.IsValid() && Corner2Y.IsValid();
-  Ready = Ready && Corner3X.IsValid() && Corner3Y.IsValid();
-  Ready = Ready && Corner4X.IsValid() && Corner4Y.IsValid();
-  return !Ready;
+      for (int i = 0; i < 4 && Inside; ++i)
+      {
+        const int Next = (i+1) % 4;
+
+        Inside = (PolygonX[Next]-PolygonX[i])*(PosY-PolygonY[i])-(PolygonY[Next]-PolygonY[i])*(PosX-PolygonX[i]) >= 0;
+      }
+      MaskData[y*RowWidth+x] = Inside ? 255 : 0;
+    }
+  }
 }
 
 
@@ -123,14 +218,14 @@ void TableMarkers::GetRotationalCorrection(MEImage& image, float& angle, MEPoint
   if (IsAnyMissingCorner())
     return;
 
-  const int PosX1 = (int)Corner1X.GetStatistic("Mean")->GetResult();
-  const int PosY1 = (int)Corner1Y.GetStatistic("Mean")->GetResult();
-  const int PosX2 = (int)Corner2X.GetStatistic("Mean")->GetResult();
-  const int PosY2 = (int)Corner2Y.GetStatistic("Mean")->GetResult();
-  const int PosX3 = (int)Corner3X.GetStatistic("Mean")->GetResult();
-  const int PosY3 = (int)Corner3Y.GetStatistic("Mean")->GetResult();
-  const int PosX4 = (int)Corner4X.GetStatistic("Mean")->GetResult();
-  const int PosY4 = (int)Corner4Y.GetStatistic("Mean")->GetResult();
+  const int PosX1 = Corners->GetMean(0).X;
+  const int PosY1 = Corners->GetMean(0).Y;
+  const int PosX2 = Corners->GetMean(1).X;
+  const int PosY2 = Corners->GetMean(1).Y;
+  const int PosX3 = Corners->GetMean(2).X;
+  const int PosY3 = Corners->GetMean(2).Y;
+  const int PosX4 = Corners->GetMean(3).X;
+  const int PosY4 = Corners->GetMean(3).Y;
   MEPoint Point1((PosX1+PosX2) / 2, (PosY1+PosY2) / 2);
   MEPoint Point2((PosX3+PosX4) / 2, (PosY3+PosY4) / 2);
   float Degree = MEGetInteriorAngle(Point2, Point1, MEPoint((PosX1+PosX2) / 2, image.GetHeight()));
@@ -141,155 +236,200 @@ void TableMarkers::GetRotationalCorrection(MEImage& image, float& angle, MEPoint
 }
 
 
-void TableMarkers::DrawMissingCorners(MEImage& image)
+void TableMarkers::DrawMissingCorners(OverlayLayer& overlay)
 {
-  if (FrameCount < FrameLimit)
+  if (FrameCount < LearningLimit)
     return;
 
-  if (!Corner1X.IsValid() || !Corner1Y.IsValid())
+  if (!Corners->IsValid(0))
   {
-    image.DrawRectangle(RegionGap, RegionGap, CornerRegionWidth, CornerRegionHeight, MEColor(255, 70, 70), false);
+    overlay.AddRectangle(RegionGap, RegionGap, CornerRegionWidth, CornerRegionHeight, MEColor(255, 70, 70));
   }
-  if (!Corner2X.IsValid() || !Corner2Y.IsValid())
+  if (!Corners->IsValid(1))
   {
-    image.DrawRectangle(image.GetWidth()-1-CornerRegionWidth, RegionGap, image.GetWidth()-1-RegionGap, CornerRegionHeight,
-                        MEColor(255, 70, 70), false);
+    overlay.AddRectangle(ImageWidth-1-CornerRegionWidth, RegionGap, ImageWidth-1-RegionGap, CornerRegionHeight,
+                         MEColor(255, 70, 70));
   }
-  if (!Corner3X.IsValid() || !Corner3Y.IsValid())
+  if (!Corners->IsValid(2))
   {
-    image.DrawRectangle(RegionGap, image.GetHeight()-1-CornerRegionHeight, CornerRegionWidth, image.GetHeight()-1-RegionGap,
-                        MEColor(255, 70, 70), false);
+    overlay.AddRectangle(RegionGap, ImageHeight-1-CornerRegionHeight, CornerRegionWidth, ImageHeight-1-RegionGap,
+                         MEColor(255, 70, 70));
   }
-  if (!Corner4X.IsValid() || !Corner4Y.IsValid())
+  if (!Corners->IsValid(3))
   {
-    image.DrawRectangle(image.GetWidth()-1-CornerRegionWidth, image.GetHeight()-1-CornerRegionHeight,
-                        image.GetWidth()-1-RegionGap, image.GetHeight()-1-RegionGap, MEColor(255, 70, 70), false);
+    overlay.AddRectangle(ImageWidth-1-CornerRegionWidth, ImageHeight-1-CornerRegionHeight,
+                         ImageWidth-1-RegionGap, ImageHeight-1-RegionGap, MEColor(255, 70, 70));
   }
 }
 
 
-void TableMarkers::DrawDebugSigns(MEImage& image)
+void TableMarkers::DrawDebugSigns(OverlayLayer& overlay)
 {
-  MEImage TempImage(ImageWidth, ImageHeight, 3);
-
-  TempImage.Clear();
-  TempImage.DrawRectangle(RegionGap, RegionGap, CornerRegionWidth, CornerRegionHeight,
-                          MEColor(0, 255, 0), false);
-  TempImage.DrawRectangle(TempImage.GetWidth()-1-CornerRegionWidth, RegionGap,
-                          TempImage.GetWidth()-1-RegionGap, CornerRegionHeight, MEColor(0, 255, 0), false);
-  TempImage.DrawRectangle(RegionGap, TempImage.GetHeight()-1-CornerRegionHeight,
-                          CornerRegionWidth, TempImage.GetHeight()-1-RegionGap, MEColor(0, 255, 0), false);
-  TempImage.DrawRectangle(TempImage.GetWidth()-1-CornerRegionWidth, TempImage.GetHeight()-1-CornerRegionHeight,
-                          TempImage.GetWidth()-1-RegionGap, TempImage.GetHeight()-1-RegionGap, MEColor(0, 255, 0), false);
-
-  const int PosX1 = (int)Corner1X.GetStatistic("Mean")->GetResult();
-  const int PosY1 = (int)Corner1Y.GetStatistic("Mean")->GetResult();
-  const int PosX2 = (int)Corner2X.GetStatistic("Mean")->GetResult();
-  const int PosY2 = (int)Corner2Y.GetStatistic("Mean")->GetResult();
-  const int PosX3 = (int)Corner3X.GetStatistic("Mean")->GetResult();
-  const int PosY3 = (int)Corner3Y.GetStatistic("Mean")->GetResult();
-  const int PosX4 = (int)Corner4X.GetStatistic("Mean")->GetResult();
-  const int PosY4 = (int)Corner4Y.GetStatistic("Mean")->GetResult();
+  if (Tracking)
+  {
+    // Draw the tracking windows
+    for (int i = 0; i < 4; ++i)
+    {
+      int X1, Y1, X2, Y2;
+
+      GetTrackingWindow(TrackedCorners[i], X1, Y1, X2, Y2);
+      overlay.AddRectangle(X1, Y1, X2, Y2, MissedChecks[i] > 0 ? MEColor(255, 70, 70) : MEColor(0, 255, 0));
+    }
+  } else {
+    overlay.AddRectangle(RegionGap, RegionGap, CornerRegionWidth, CornerRegionHeight,
+                         MEColor(0, 255, 0));
+    overlay.AddRectangle(ImageWidth-1-CornerRegionWidth, RegionGap,
+                         ImageWidth-1-RegionGap, CornerRegionHeight, MEColor(0, 255, 0));
+    overlay.AddRectangle(RegionGap, ImageHeight-1-CornerRegionHeight,
+                         CornerRegionWidth, ImageHeight-1-RegionGap, MEColor(0, 255, 0));
+    overlay.AddRectangle(ImageWidth-1-CornerRegionWidth, ImageHeight-1-CornerRegionHeight,
+                         ImageWidth-1-RegionGap, ImageHeight-1-RegionGap, MEColor(0, 255, 0));
+  }
+
+  const int PosX1 = Corners->GetMean(0).X;
+  const int PosY1 = Corners->GetMean(0).Y;
+  const int PosX2 = Corners->GetMean(1).X;
+  const int PosY2 = Corners->GetMean(1).Y;
+  const int PosX3 = Corners->GetMean(2).X;
+  const int PosY3 = Corners->GetMean(2).Y;
+  const int PosX4 = Corners->GetMean(3).X;
+  const int PosY4 = Corners->GetMean(3).Y;
 
   // Draw the detected corners
-  if (Corner1X.IsValid() && Corner1Y.IsValid())
-    TempImage.DrawCircle(PosX1, PosY1, 5, MEColor(0, 0, 255));
-  if (Corner2X.IsValid() && Corner2Y.IsValid())
-    TempImage.DrawCircle(PosX2, PosY2, 5, MEColor(0, 0, 255));
-  if (Corner3X.IsValid() && Corner3Y.IsValid())
-    TempImage.DrawCircle(PosX3, PosY3, 5, MEColor(0, 0, 255));
-  if (Corner4X.IsValid() && Corner4Y.IsValid())
-    TempImage.DrawCircle(PosX4, PosY4, 5, MEColor(0, 0, 255));
+  if (Corners->IsValid(0))
+    overlay.AddCircle(PosX1, PosY1, 5, MEColor(0, 0, 255));
+  if (Corners->IsValid(1))
+    overlay.AddCircle(PosX2, PosY2, 5, MEColor(0, 0, 255));
+  if (Corners->IsValid(2))
+    overlay.AddCircle(PosX3, PosY3, 5, MEColor(0, 0, 255));
+  if (Corners->IsValid(3))
+    overlay.AddCircle(PosX4, PosY4, 5, MEColor(0, 0, 255));
 
   // Draw intermediate points and lines
-  if (Corner1X.IsValid() && Corner1Y.IsValid() && Corner2X.IsValid() && Corner2Y.IsValid() &&
-      Corner3X.IsValid() && Corner3Y.IsValid() && Corner4X.IsValid() && Corner4Y.IsValid())
+  if (Corners->AreAllValid())
   {
-    TempImage.DrawCircle((PosX1+PosX2) / 2, (PosY1+PosY2) / 2, 5, MEColor(255, 255, 0));
-    TempImage.DrawCircle((PosX3+PosX4) / 2, (PosY3+PosY4) / 2, 5, MEColor(255, 255, 0));
-    TempImage.DrawCircle((PosX1+PosX3) / 2, (PosY1+PosY3) / 2, 5, MEColor(255, 255, 0));
-    TempImage.DrawCircle((PosX2+PosX4) / 2, (PosY2+PosY4) / 2, 5, MEColor(255, 255, 0));
-
-    TempImage.DrawLine((PosX1+PosX2) / 2, (PosY1+PosY2) / 2,
-                       (PosX3+PosX4) / 2, (PosY3+PosY4) / 2, MEColor(255, 255, 0));
-    TempImage.DrawLine((PosX1+PosX3) / 2, (PosY1+PosY3) / 2,
-                       (PosX2+PosX4) / 2, (PosY2+PosY4) / 2, MEColor(255, 255, 0));
+    overlay.AddCircle((PosX1+PosX2) / 2, (PosY1+PosY2) / 2, 5, MEColor(255, 255, 0));
+    overlay.AddCircle((PosX3+PosX4) / 2, (PosY3+PosY4) / 2, 5, MEColor(255, 255, 0));
+    overlay.AddCircle((PosX1+PosX3) / 2, (PosY1+PosY3) / 2, 5, MEColor(255, 255, 0));
+    overlay.AddCircle((PosX2+PosX4) / 2, (PosY2+PosY4) / 2, 5, MEColor(255, 255, 0));
+
+    overlay.AddLine((PosX1+PosX2) / 2, (PosY1+PosY2) / 2,
+                    (PosX3+PosX4) / 2, (PosY3+PosY4) / 2, MEColor(255, 255, 0));
+    overlay.AddLine((PosX1+PosX3) / 2, (PosY1+PosY3) / 2,
+                    (PosX2+PosX4) / 2, (PosY2+PosY4) / 2, MEColor(255, 255, 0));
   }
-  TempImage.Resize(image.GetWidth(), image.GetHeight());
-  image.Addition(TempImage, ME::MaskAddition);
 }
 
 
-MEPoint TableMarkers::FindCorner(MEImage& image, int x1, int y1, int x2, int y2)
+
+void TableMarkers::SaveSnapshot(Snapshot& snapshot)
 {
-  const int X1 = MCBound(0, x1, image.GetWidth()-1);
-  const int Y1 = MCBound(0, y1, image.GetHeight()-1);
-  const int X2 = MCBound(0, x2, image.GetWidth()-1);
-  const int Y2 = MCBound(0, y2, image.GetHeight()-1);
-
-  if (X2-X1 <= 0 || Y2-Y1 <= 0)
-    return MEPoint(-1, -1);
-
-  // Copy the search region
-  ME::ImageSPtr RegionImage(new MEImage);
-  float Brightness = 0;
-  const float BrightnessLimit = 110;
-
-  image.CopyImagePart(X1, Y1, X2, Y2, *RegionImage);
-  RegionImage->ConvertToGrayscale();
-  Brightness = RegionImage->AverageBrightnessLevel();
-  if (Brightness > BrightnessLimit)
+  snapshot.Locked = Tracking;
+  for (int i = 0; i < 4; ++i)
   {
-    printf("Region (%dx%d-%dx%d) is too bright (%1.2f > %1.0f)\n", x1, y1, x2, y2, Brightness, BrightnessLimit);
-    return MEPoint(-1, -1);
+    snapshot.Corners[i] = TrackedCorners[i];
+    snapshot.References[i] = TrackingReferences[i];
   }
-  RegionImage->AdaptiveThreshold();
-  RegionImage->Binarize(1);
+}
+
 
-  unsigned char* ImageData = (unsigned char*)RegionImage->GetIplImage()->imageData;
-  int RowStart = 0;
-  MC::IntList PositionsX;
-  MC::IntList PositionsY;
+bool TableMarkers::RestoreSnapshot(const Snapshot& snapshot, MEImage& image)
+{
+  if (!snapshot.Locked)
+    return false;
 
-  // Search for vertical positions
-  for (int y = 0; y < RegionImage->GetHeight(); ++y)
+  // Check that the corners are still at the same place
+  Finder->SetImage(image);
+  for (int i = 0; i < 4; ++i)
   {
-    int WhiteCounter = 0;
+    MEPoint Point = FindTrackedCorner(snapshot.Corners[i]);
 
-    for (int x = RegionImage->GetWidth()-1; x >= 0; --x)
-    {
-      if (ImageData[RowStart+x] > 0)
-        WhiteCounter++;
-    }
-    if (WhiteCounter > 10)
-      PositionsY.push_back(y);
+    if (!Point.IsValid())
+      return false;
 
-    RowStart += RegionImage->GetRowWidth();
+    if (snapshot.References[i].IsValid() && (abs(Point.X-snapshot.References[i].X) > TrackingTolerance ||
+                                             abs(Point.Y-snapshot.References[i].Y) > TrackingTolerance))
+      return false;
   }
-  // Search for horizontal positions
-  for (int x = 0; x < RegionImage->GetWidth(); ++x)
+  // Restore the lock
+  Reset();
+  for (int i = 0; i < 4; ++i)
   {
-    int WhiteCounter = 0;
+    Corners->Fill(i, snapshot.Corners[i].X, snapshot.Corners[i].Y);
+    TrackedCorners[i] = snapshot.Corners[i];
+    TrackingReferences[i] = snapshot.References[i];
+    MissedChecks[i] = 0;
+  }
+  FrameCount = LearningLimit;
+  TrackingFrameCount = 0;
+  Tracking = true;
+  return true;
+}
 
-    RowStart = x;
-    for (int y = 0; y < RegionImage->GetHeight(); ++y)
-    {
-      if (ImageData[RowStart] > 0)
-        WhiteCounter++;
 
-      RowStart += RegionImage->GetRowWidth();
+void TableMarkers::StartTracking()
+{
+  GetTableCorners(TrackedCorners);
+  for (int i = 0; i < 4; ++i)
+  {
+    // The references are set by the first window search
+    TrackingReferences[i] = MEPoint(-1, -1);
+    MissedChecks[i] = 0;
+  }
+  TrackingFrameCount = 0;
+  Tracking = true;
+  if (Logging)
+    MC_LOG("Table corners locked, switch to tracking");
+}
+
+
+void TableMarkers::TrackCorners(MEImage& image)
+{
+  Finder->SetImage(image);
+  for (int i = 0; i < 4; ++i)
+  {
+    MEPoint Point = FindTrackedCorner(TrackedCorners[i]);
+
+    if (!Point.IsValid())
+    {
+      MissedChecks[i]++;
+    } else
+    if (!TrackingReferences[i].IsValid())
+    {
+      TrackingReferences[i] = Point;
+      MissedChecks[i] = 0;
+    } else
+    if (abs(Point.X-TrackingReferences[i].X) > TrackingTolerance || abs(Point.Y-TrackingReferences[i].Y) > TrackingTolerance)
+    {
+      MissedChecks[i]++;
+    } else {
+      MissedChecks[i] = 0;
+    }
+    if (MissedChecks[i] >= TrackingMissLimit)
+    {
+      if (Logging)
+        MC_LOG("Table corner %d is lost, restart the full corner search", i+1);
+      Reset();
+      return;
     }
-    if (WhiteCounter > 10)
-      PositionsX.push_back(x);
   }
-  if (PositionsX.empty() || PositionsY.empty())
-    return MEPoint(-1, -1);
+}
+
+
+MEPoint TableMarkers::FindTrackedCorner(const MEPoint& corner)
+{
+  int X1, Y1, X2, Y2;
 
-  if (PositionsX.size() == 1 || PositionsY.size() == 1)
-    return MEPoint(PositionsX[0], PositionsY[0]);
+  GetTrackingWindow(corner, X1, Y1, X2, Y2);
+  // The positions are compared with the references in image coordinates
+  return Finder->FindCorner(X1, Y1, X2, Y2, true);
+}
 
-  int PosX = x1+(int)MCCalculateVectorStatistic(PositionsX, *new MCArithmeticMean<int>);
-  int PosY = y1+(int)MCCalculateVectorStatistic(PositionsY, *new MCArithmeticMean<int>);
 
-  return MEPoint(PosX, PosY);
+void TableMarkers::GetTrackingWindow(const MEPoint& corner, int& x1, int& y1, int& x2, int& y2)
+{
+  x1 = corner.X-TrackingWindowWidth;
+  y1 = corner.Y-TrackingWindowHeight;
+  x2 = corner.X+TrackingWindowWidth;
+  y2 = corner.Y+TrackingWindowHeight;
 }
@@ -22,45 +22,75 @@
 #ifndef TableMarkers_hpp
 #define TableMarkers_hpp
 
-#include <MCSamples.hpp>
+#include <MEDefs.hpp>
 
+#include <boost/scoped_ptr.hpp>
+
+class CornerAccumulator;
+class CornerFinder;
 class MEImage;
-class MEPoint;
+class OverlayLayer;
 
 class TableMarkers
 {
 public:
-  TableMarkers(int image_width, int image_height);
+  struct Snapshot
+  {
+    Snapshot() : Locked(false) {}
+
+    bool Locked;
+    MEPoint Corners[4];
+    MEPoint References[4];
+  };
+
+  TableMarkers(int image_width, int image_height, bool logging);
   virtual ~TableMarkers();
 
   void Reset();
   void AddImage(MEImage& image);
+  void GetSearchRegion(int corner, int& x1, int& y1, int& x2, int& y2);
   bool IsReady();
+  bool IsTracking();
   bool IsAnyMissingCorner();
+  bool GetTableCorners(MEPoint* corners);
+  bool GetTableRegion(int margin, int& x1, int& y1, int& x2, int& y2);
+  void CreateTableMask(int margin, int x1, int y1, int x2, int y2, MEImage& mask);
   void GetRotationalCorrection(MEImage& image, float& angle, MEPoint& center);
-  void DrawMissingCorners(MEImage& image);
-  void DrawDebugSigns(MEImage& image);
+  void DrawMissingCorners(OverlayLayer& overlay);
+  void DrawDebugSigns(OverlayLayer& overlay);
+  void SaveSnapshot(Snapshot& snapshot);
+  bool RestoreSnapshot(const Snapshot& snapshot, MEImage& image);
 
 private:
-  MEPoint FindCorner(MEImage& image, int x1, int y1, int x2, int y2);
+  void StartTracking();
+  void TrackCorners(MEImage& image);
+  MEPoint FindTrackedCorner(const MEPoint& corner);
+  void GetTrackingWindow(const MEPoint& corner, int& x1, int& y1, int& x2, int& y2);
 
 protected:
   const int ImageWidth;
   const int ImageHeight;
+  const bool Logging;
   const int FrameLimit;
+  const int MaxFrameLimit;
   const int CornerSampleCount;
   const int CornerRegionWidth;
   const int CornerRegionHeight;
   const int RegionGap;
+  const int TrackingInterval;
+  const int TrackingWindowWidth;
+  const int TrackingWindowHeight;
+  const int TrackingTolerance;
+  const int TrackingMissLimit;
+  int LearningLimit;
   int FrameCount;
-  MCSamples<int> Corner1X;
-  MCSamples<int> Corner1Y;
-  MCSamples<int> Corner2X;
-  MCSamples<int> Corner2Y;
-  MCSamples<int> Corner3X;
-  MCSamples<int> Corner3Y;
-  MCSamples<int> Corner4X;
-  MCSamples<int> Corner4Y;
+  bool Tracking;
+  int TrackingFrameCount;
+  MEPoint TrackedCorners[4];
+  MEPoint TrackingReferences[4];
+  int MissedChecks[4];
+  boost::scoped_ptr<CornerFinder> Finder;
+  boost::scoped_ptr<CornerAccumulator> Corners;
 };
 
 #endif
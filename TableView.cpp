@@ -0,0 +1,286 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "TableView.hpp"
+
+#include <MEImage.hpp>
+
+#include <opencv/cv.h>
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+TableView::TableView(int width, int height, int margin) : Width(width), Height(height), Margin(margin), Valid(false),
+  RegionX1(0), RegionY1(0), RegionX2(0), RegionY2(0)
+{
+  MapX.resize(Width*Height);
+  MapY.resize(Width*Height);
+  WeightX.resize(Width*Height);
+  WeightY.resize(Width*Height);
+}
+
+
+TableView::~TableView()
+{
+}
+
+
+void TableView::Reset()
+{
+  Valid = false;
+}
+
+
+bool TableView::SetCorners(const MEPoint* corners)
+{
+  // The table rectangle in the rectified view
+  const float TableX[4] = { (float)Margin, (float)(Width-1-Margin), (float)Margin, (float)(Width-1-Margin) };
+  const float TableY[4] = { (float)Margin, (float)Margin, (float)(Height-1-Margin), (float)(Height-1-Margin) };
+  float ImageX[4];
+  float ImageY[4];
+
+  for (int i = 0; i < 4; ++i)
+  {
+    ImageX[i] = corners[i].X;
+    ImageY[i] = corners[i].Y;
+  }
+  Valid = CalculateHomography(TableX, TableY, ImageX, ImageY, Homography) &&
+          InvertHomography(Homography, InverseHomography);
+  if (!Valid)
+    return false;
+
+  // Build the warp map with 8 bit bilinear weights
+  RegionX1 = RegionY1 = 1 << 30;
+  RegionX2 = RegionY2 = -(1 << 30);
+  for (int y = 0; y < Height; ++y)
+  {
+    for (int x = 0; x < Width; ++x)
+    {
+      const double W = Homography[6]*x+Homography[7]*y+Homography[8];
+      const double SourceX = (Homography[0]*x+Homography[1]*y+Homography[2]) / W;
+      const double SourceY = (Homography[3]*x+Homography[4]*y+Homography[5]) / W;
+      const int Index = y*Width+x;
+
+      MapX[Index] = (int)floor(SourceX);
+      MapY[Index] = (int)floor(SourceY);
+      WeightX[Index] = (unsigned char)((SourceX-MapX[Index])*255+0.5);
+      WeightY[Index] = (unsigned char)((SourceY-MapY[Index])*255+0.5);
+      RegionX1 = std::min(RegionX1, MapX[Index]);
+      RegionY1 = std::min(RegionY1, MapY[Index]);
+      RegionX2 = std::max(RegionX2, MapX[Index]+1);
+      RegionY2 = std::max(RegionY2, MapY[Index]+1);
+    }
+  }
+  return true;
+}
+
+
+bool TableView::IsValid() const
+{
+  return Valid;
+}
+
+
+int TableView::GetWidth() const
+{
+  return Width;
+}
+
+
+int TableView::GetHeight() const
+{
+  return Height;
+}
+
+
+void TableView::Rectify(const MEImage& image, MEImage& table_image)
+{
+  const IplImage* Source = image.GetIplImage();
+
+  if (table_image.GetWidth() != Width || table_image.GetHeight() != Height ||
+      table_image.GetIplImage()->nChannels != Source->nChannels)
+  {
+    table_image = MEImage(Width, Height, Source->nChannels);
+  }
+  IplImage* Target = table_image.GetIplImage();
+  const int Channels = Source->nChannels;
+  const int MaxX = Source->width-2;
+  const int MaxY = Source->height-2;
+
+  if (!Valid || MaxX < 0 || MaxY < 0)
+  {
+    memset(Target->imageData, 0, Target->widthStep*Height);
+    return;
+  }
+  for (int y = 0; y < Height; ++y)
+  {
+    unsigned char* TargetRow = (unsigned char*)Target->imageData+y*Target->widthStep;
+
+    for (int x = 0; x < Width; ++x)
+    {
+      const int Index = y*Width+x;
+      const int SourceX = MapX[Index];
+      const int SourceY = MapY[Index];
+
+      if (SourceX < 0 || SourceY < 0 || SourceX > MaxX || SourceY > MaxY)
+      {
+        memset(TargetRow+x*Channels, 0, Channels);
+        continue;
+      }
+      const unsigned char* Pixel = (const unsigned char*)Source->imageData+SourceY*Source->widthStep+SourceX*Channels;
+      const int WX = WeightX[Index];
+      const int WY = WeightY[Index];
+
+      for (int c = 0; c < Channels; ++c)
+      {
+        const int Top = Pixel[c]*(255-WX)+Pixel[c+Channels]*WX;
+        const int Bottom = Pixel[c+Source->widthStep]*(255-WX)+Pixel[c+Source->widthStep+Channels]*WX;
+
+        TargetRow[x*Channels+c] = (unsigned char)((Top*(255-WY)+Bottom*WY+32512) / 65025);
+      }
+    }
+  }
+}
+
+
+void TableView::ProjectMask(const MEImage& mask, MEImage& image)
+{
+  const IplImage* Mask = mask.GetIplImage();
+  IplImage* Target = image.GetIplImage();
+
+  if (!Valid || Mask->width != Width || Mask->height != Height)
+    return;
+
+  const int X1 = std::max(RegionX1, 0);
+  const int Y1 = std::max(RegionY1, 0);
+  const int X2 = std::min(RegionX2, Target->width-1);
+  const int Y2 = std::min(RegionY2, Target->height-1);
+
+  for (int y = Y1; y <= Y2; ++y)
+  {
+    unsigned char* TargetRow = (unsigned char*)Target->imageData+y*Target->widthStep;
+
+    for (int x = X1; x <= X2; ++x)
+    {
+      MEPoint Point = ImageToTable(x, y);
+
+      if (Point.X < 0 || Point.Y < 0 || Point.X >= Width || Point.Y >= Height)
+        continue;
+
+      const unsigned char Value = ((const unsigned char*)Mask->imageData)[Point.Y*Mask->widthStep+Point.X];
+
+      if (Value > 0)
+        memset(TargetRow+x*Target->nChannels, Value, Target->nChannels);
+    }
+  }
+}
+
+
+MEPoint TableView::ImageToTable(float x, float y) const
+{
+  const double W = InverseHomography[6]*x+InverseHomography[7]*y+InverseHomography[8];
+
+  return MEPoint((int)floor((InverseHomography[0]*x+InverseHomography[1]*y+InverseHomography[2]) / W+0.5),
+                 (int)floor((InverseHomography[3]*x+InverseHomography[4]*y+InverseHomography[5]) / W+0.5));
+}
+
+
+bool TableView::CalculateHomography(const float* source_x, const float* source_y, const float* target_x,
+                                    const float* target_y, double* homography)
+{
+  // Solve the 8x8 linear system of the point pairs with Gaussian elimination (h33 = 1)
+  double Matrix[8][9];
+
+  for (int i = 0; i < 4; ++i)
+  {
+    double* Row1 = Matrix[i*2];
+    double* Row2 = Matrix[i*2+1];
+
+    Row1[0] = source_x[i];
+    Row1[1] = source_y[i];
+    Row1[2] = 1;
+    Row1[3] = Row1[4] = Row1[5] = 0;
+    Row1[6] = -target_x[i]*source_x[i];
+    Row1[7] = -target_x[i]*source_y[i];
+    Row1[8] = target_x[i];
+    Row2[0] = Row2[1] = Row2[2] = 0;
+    Row2[3] = source_x[i];
+    Row2[4] = source_y[i];
+    Row2[5] = 1;
+    Row2[6] = -target_y[i]*source_x[i];
+    Row2[7] = -target_y[i]*source_y[i];
+    Row2[8] = target_y[i];
+  }
+  for (int c = 0; c < 8; ++c)
+  {
+    int Pivot = c;
+
+    for (int r = c+1; r < 8; ++r)
+    {
+      if (fabs(Matrix[r][c]) > fabs(Matrix[Pivot][c]))
+        Pivot = r;
+    }
+    if (fabs(Matrix[Pivot][c]) < 1e-9)
+      return false;
+
+    if (Pivot != c)
+    {
+      for (int k = 0; k < 9; ++k)
+        std::swap(Matrix[c][k], Matrix[Pivot][k]);
+    }
+    for (int r = 0; r < 8; ++r)
+    {
+      if (r == c)
+        continue;
+
+      const double Factor = Matrix[r][c] / Matrix[c][c];
+
+      for (int k = c; k < 9; ++k)
+        Matrix[r][k] -= Factor*Matrix[c][k];
+    }
+  }
+  for (int i = 0; i < 8; ++i)
+    homography[i] = Matrix[i][8] / Matrix[i][i];
+  homography[8] = 1;
+  return true;
+}
+
+
+bool TableView::InvertHomography(const double* homography, double* inverse)
+{
+  const double* H = homography;
+  const double Determinant = H[0]*(H[4]*H[8]-H[5]*H[7])-H[1]*(H[3]*H[8]-H[5]*H[6])+H[2]*(H[3]*H[7]-H[4]*H[6]);
+
+  if (fabs(Determinant) < 1e-12)
+    return false;
+
+  inverse[0] = (H[4]*H[8]-H[5]*H[7]) / Determinant;
+  inverse[1] = (H[2]*H[7]-H[1]*H[8]) / Determinant;
+  inverse[2] = (H[1]*H[5]-H[2]*H[4]) / Determinant;
+  inverse[3] = (H[5]*H[6]-H[3]*H[8]) / Determinant;
+  inverse[4] = (H[0]*H[8]-H[2]*H[6]) / Determinant;
+  inverse[5] = (H[2]*H[3]-H[0]*H[5]) / Determinant;
+  inverse[6] = (H[3]*H[7]-H[4]*H[6]) / Determinant;
+  inverse[7] = (H[1]*H[6]-H[0]*H[7]) / Determinant;
+  inverse[8] = (H[0]*H[4]-H[1]*H[3]) / Determinant;
+  return true;
+}
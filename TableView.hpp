@@ -0,0 +1,75 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef TableView_hpp
+#define TableView_hpp
+
+#include <MEDefs.hpp>
+
+#include <vector>
+
+class MEImage;
+
+/**
+ * Rectified top-down view of the table.
+ *
+ * The four table corners (top-left, top-right, bottom-left, bottom-right) define
+ * a homography to a fixed size image where the table is an axis aligned rectangle
+ * surrounded by a margin. The bilinear warp map is calculated once per corner set
+ * and every frame is rectified with a lookup.
+ */
+class TableView
+{
+public:
+  TableView(int width, int height, int margin);
+  virtual ~TableView();
+
+  void Reset();
+  bool SetCorners(const MEPoint* corners);
+  bool IsValid() const;
+  int GetWidth() const;
+  int GetHeight() const;
+  void Rectify(const MEImage& image, MEImage& table_image);
+  void ProjectMask(const MEImage& mask, MEImage& image);
+  MEPoint ImageToTable(float x, float y) const;
+
+  static bool CalculateHomography(const float* source_x, const float* source_y, const float* target_x,
+                                  const float* target_y, double* homography);
+  static bool InvertHomography(const double* homography, double* inverse);
+
+protected:
+  const int Width;
+  const int Height;
+  const int Margin;
+  bool Valid;
+  double Homography[9];
+  double InverseHomography[9];
+  int RegionX1;
+  int RegionY1;
+  int RegionX2;
+  int RegionY2;
+  std::vector<int> MapX;
+  std::vector<int> MapY;
+  std::vector<unsigned char> WeightX;
+  std::vector<unsigned char> WeightY;
+};
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "TileDeltaDecoder.hpp"
+
+#include <string.h>
+
+namespace
+{
+// Size of the message header and the tile headers (bytes)
+const int MessageHeaderSize = 7;
+const int TileHeaderSize = 12;
+
+
+int ReadUInt16(const unsigned char* data)
+{
+  return (data[0] << 8) | data[1];
+}
+
+
+unsigned int ReadUInt32(const unsigned char* data)
+{
+  return ((unsigned int)data[0] << 24) | ((unsigned int)data[1] << 16) | ((unsigned int)data[2] << 8) | data[3];
+}
+}
+
+TileDeltaDecoder::TileDeltaDecoder() : Valid(false)
+{
+}
+
+
+bool TileDeltaDecoder::IsTileMessage(const QByteArray& message)
+{
+  // A plain JPEG frame starts with 0xFF, a tile message with its type (0 or 1)
+  return message.size() >= MessageHeaderSize && (message[0] == 0 || message[0] == 1);
+}
+
+
+void TileDeltaDecoder::Reset()
+{
+  Frame = QImage();
+  Valid = false;
+}
+
+
+bool TileDeltaDecoder::Decode(const QByteArray& message, bool& keyframe, int& tile_count)
+{
+  const unsigned char* Data = (const unsigned char*)message.constData();
+  const int Size = message.size();
+
+  keyframe = false;
+  tile_count = 0;
+  if (!IsTileMessage(message))
+    return false;
+
+  const int Width = ReadUInt16(Data+1);
+  const int Height = ReadUInt16(Data+3);
+  const int TileCount = ReadUInt16(Data+5);
+
+  keyframe = Data[0] == 0;
+  if (keyframe)
+  {
+    Frame = QImage(Width, Height, QImage::Format_RGB888);
+    Valid = true;
+  }
+  // The deltas are relative to the last keyframe of the same size
+  if (!Valid || Frame.width() != Width || Frame.height() != Height)
+    return false;
+
+  int Offset = MessageHeaderSize;
+
+  for (int i = 0; i < TileCount; ++i)
+  {
+    if (Offset+TileHeaderSize > Size)
+      break;
+
+    const int X = ReadUInt16(Data+Offset);
+    const int Y = ReadUInt16(Data+Offset+2);
+    const int TileWidth = ReadUInt16(Data+Offset+4);
+    const int TileHeight = ReadUInt16(Data+Offset+6);
+    const unsigned int JpegSize = ReadUInt32(Data+Offset+8);
+
+    Offset += TileHeaderSize;
+    if (JpegSize > (unsigned int)(Size-Offset) || X+TileWidth > Width || Y+TileHeight > Height)
+      break;
+
+    QImage Tile;
+
+    if (!Tile.loadFromData(Data+Offset, (int)JpegSize, "JPG") || Tile.width() != TileWidth ||
+        Tile.height() != TileHeight || !CopyTile(Tile, X, Y))
+    {
+      break;
+    }
+    Offset += (int)JpegSize;
+    tile_count++;
+  }
+  // A partially applied message leaves an inconsistent frame behind
+  if (tile_count != TileCount || Offset != Size)
+  {
+    Valid = false;
+    return false;
+  }
+  return true;
+}
+
+
+bool TileDeltaDecoder::HasFrame() const
+{
+  return Valid;
+}
+
+
+const QImage& TileDeltaDecoder::GetFrame() const
+{
+  return Frame;
+}
+
+
+bool TileDeltaDecoder::CopyTile(const QImage& tile, int x, int y)
+{
+  const QImage Source = tile.convertToFormat(QImage::Format_RGB888);
+
+  if (Source.isNull())
+    return false;
+
+  for (int i = 0; i < Source.height(); ++i)
+    memcpy(Frame.scanLine(y+i)+x*3, Source.constScanLine(i), Source.width()*3);
+  return true;
+}
@@ -0,0 +1,55 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef TileDeltaDecoder_hpp
+#define TileDeltaDecoder_hpp
+
+#include <qbytearray.h>
+#include <qimage.h>
+
+/**
+ * Rebuilds the frames of the tile delta stream of TileDeltaEncoder.
+ *
+ * A keyframe replaces the frame, the tiles of a delta message are decoded and
+ * copied over the previous frame. A delta message can not be applied before a
+ * keyframe or after a broken message, the decoder waits for the next keyframe
+ * then. The reference receivers use it to check the stream.
+ */
+class TileDeltaDecoder
+{
+public:
+  TileDeltaDecoder();
+
+  static bool IsTileMessage(const QByteArray& message);
+
+  void Reset();
+  bool Decode(const QByteArray& message, bool& keyframe, int& tile_count);
+  bool HasFrame() const;
+  const QImage& GetFrame() const;
+
+protected:
+  bool CopyTile(const QImage& tile, int x, int y);
+
+  QImage Frame;
+  bool Valid;
+};
+
+#endif
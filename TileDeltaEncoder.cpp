@@ -0,0 +1,191 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "TileDeltaEncoder.hpp"
+
+#include "EncodedFrameCache.hpp"
+
+#include <MEImage.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+// Size of the message header and the tile headers (bytes)
+const int MessageHeaderSize = 7;
+// Every second pixel of every second row is compared in a tile
+const int SampleStep = 2;
+// Summed absolute difference of the channels which counts as a changed pixel
+const int PixelThreshold = 30;
+// Number of changed samples which marks a tile changed (the ball covers about ten samples)
+const int ChangedSampleLimit = 4;
+
+
+void AppendUInt16(QByteArray& output, int value)
+{
+  output.append((char)((value >> 8) & 0xFF));
+  output.append((char)(value & 0xFF));
+}
+
+
+void AppendUInt32(QByteArray& output, unsigned int value)
+{
+  output.append((char)((value >> 24) & 0xFF));
+  output.append((char)((value >> 16) & 0xFF));
+  output.append((char)((value >> 8) & 0xFF));
+  output.append((char)(value & 0xFF));
+}
+}
+
+TileDeltaEncoder::TileDeltaEncoder(int tile_size, int keyframe_interval) : TileSize(tile_size),
+  KeyframeInterval(keyframe_interval), KeyframeRequested(1), FramesSinceKeyframe(0), Width(0), Height(0), Layers(0)
+{
+}
+
+
+void TileDeltaEncoder::RequestKeyframe()
+{
+  KeyframeRequested.store(1);
+}
+
+
+bool TileDeltaEncoder::Encode(const FrameHandle& frame, int quality, EncodedFrameCache& cache, QByteArray& output,
+                              bool& keyframe, int& tile_count)
+{
+  const MEImage& Image = frame.GetImage();
+  const IplImage* Source = Image.GetIplImage();
+  const unsigned char* Data = (const unsigned char*)Source->imageData;
+
+  // The request is taken at the decision, a request arriving later is served by the next frame
+  const bool Requested = KeyframeRequested.fetchAndStoreOrdered(0) != 0;
+
+  keyframe = Requested || FramesSinceKeyframe+1 >= KeyframeInterval ||
+             Image.GetWidth() != Width || Image.GetHeight() != Height || Image.GetLayers() != Layers;
+  tile_count = 0;
+  output.clear();
+  if (keyframe)
+  {
+    // The keyframe is the shared JPEG of the frame
+    const QByteArray Jpeg = cache.GetJpeg(frame, quality);
+
+    if (Jpeg.isEmpty())
+    {
+      RequestKeyframe();
+      return false;
+    }
+    FramesSinceKeyframe = 0;
+    Width = Image.GetWidth();
+    Height = Image.GetHeight();
+    Layers = Image.GetLayers();
+    Reference.resize(Width*Height*Layers);
+    StoreTile(Data, Source->widthStep, 0, 0, Width, Height);
+    StartMessage(output, true);
+    AppendTile(output, 0, 0, Width, Height, Jpeg);
+    tile_count = 1;
+  } else {
+    FramesSinceKeyframe++;
+    StartMessage(output, false);
+    for (int y = 0; y < Height; y += TileSize)
+    {
+      const int TileHeight = std::min(TileSize, Height-y);
+
+      for (int x = 0; x < Width; x += TileSize)
+      {
+        const int TileWidth = std::min(TileSize, Width-x);
+
+        if (!IsTileChanged(Data, Source->widthStep, x, y, TileWidth, TileHeight))
+          continue;
+
+        if (!Encoder.Encode(Data+y*Source->widthStep+x*Layers, TileWidth, TileHeight, Source->widthStep, Layers,
+                            quality, TileData))
+        {
+          // The tiles stored so far are not sent, only a keyframe brings the receiver back in sync
+          RequestKeyframe();
+          return false;
+        }
+
+        StoreTile(Data, Source->widthStep, x, y, TileWidth, TileHeight);
+        AppendTile(output, x, y, TileWidth, TileHeight, TileData);
+        tile_count++;
+      }
+    }
+  }
+  // Fill in the tile count of the header
+  output[5] = (char)((tile_count >> 8) & 0xFF);
+  output[6] = (char)(tile_count & 0xFF);
+  return true;
+}
+
+
+bool TileDeltaEncoder::IsTileChanged(const unsigned char* data, int row_stride, int x, int y, int width,
+                                     int height) const
+{
+  int ChangedSamples = 0;
+
+  for (int i = 0; i < height; i += SampleStep)
+  {
+    const unsigned char* Row = data+(y+i)*row_stride+x*Layers;
+    const unsigned char* ReferenceRow = &Reference[((y+i)*Width+x)*Layers];
+
+    for (int i1 = 0; i1 < width*Layers; i1 += SampleStep*Layers)
+    {
+      int Difference = 0;
+
+      for (int c = 0; c < Layers; ++c)
+        Difference += abs((int)Row[i1+c]-(int)ReferenceRow[i1+c]);
+
+      if (Difference > PixelThreshold && ++ChangedSamples >= ChangedSampleLimit)
+        return true;
+    }
+  }
+  return false;
+}
+
+
+void TileDeltaEncoder::StoreTile(const unsigned char* data, int row_stride, int x, int y, int width, int height)
+{
+  for (int i = 0; i < height; ++i)
+    memcpy(&Reference[((y+i)*Width+x)*Layers], data+(y+i)*row_stride+x*Layers, width*Layers);
+}
+
+
+void TileDeltaEncoder::StartMessage(QByteArray& output, bool keyframe)
+{
+  output.reserve(MessageHeaderSize);
+  output.append((char)(keyframe ? 0 : 1));
+  AppendUInt16(output, Width);
+  AppendUInt16(output, Height);
+  // The tile count is filled in at the end
+  AppendUInt16(output, 0);
+}
+
+
+void TileDeltaEncoder::AppendTile(QByteArray& output, int x, int y, int width, int height, const QByteArray& jpeg)
+{
+  AppendUInt16(output, x);
+  AppendUInt16(output, y);
+  AppendUInt16(output, width);
+  AppendUInt16(output, height);
+  AppendUInt32(output, (unsigned int)jpeg.size());
+  output.append(jpeg);
+}
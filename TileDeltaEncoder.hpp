@@ -0,0 +1,74 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef TileDeltaEncoder_hpp
+#define TileDeltaEncoder_hpp
+
+#include "FrameHandle.hpp"
+#include "JpegEncoder.hpp"
+
+#include <qatomic.h>
+#include <qbytearray.h>
+
+#include <vector>
+
+class EncodedFrameCache;
+
+/**
+ * Encodes the image stream as periodic keyframes and changed JPEG tiles between them.
+ *
+ * A tile is sent when enough sampled pixels differ from the last sent version of
+ * the tile. The message of a frame (all numbers are big-endian):
+ *
+ *   uint8 type (0: keyframe, 1: delta), uint16 width, uint16 height, uint16 tile count,
+ *   then for every tile: uint16 x, uint16 y, uint16 width, uint16 height, uint32 JPEG size, JPEG data
+ *
+ * A keyframe is a single tile with the whole frame. TileDeltaDecoder rebuilds the
+ * frames from the messages.
+ */
+class TileDeltaEncoder
+{
+public:
+  TileDeltaEncoder(int tile_size, int keyframe_interval);
+
+  void RequestKeyframe();
+  bool Encode(const FrameHandle& frame, int quality, EncodedFrameCache& cache, QByteArray& output,
+              bool& keyframe, int& tile_count);
+
+protected:
+  bool IsTileChanged(const unsigned char* data, int row_stride, int x, int y, int width, int height) const;
+  void StoreTile(const unsigned char* data, int row_stride, int x, int y, int width, int height);
+  void StartMessage(QByteArray& output, bool keyframe);
+  void AppendTile(QByteArray& output, int x, int y, int width, int height, const QByteArray& jpeg);
+
+  const int TileSize;
+  const int KeyframeInterval;
+  QAtomicInt KeyframeRequested;
+  int FramesSinceKeyframe;
+  int Width;
+  int Height;
+  int Layers;
+  std::vector<unsigned char> Reference;
+  JpegEncoder Encoder;
+  QByteArray TileData;
+};
+
+#endif
@@ -0,0 +1,98 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "UdpFragmenter.hpp"
+
+#include <string.h>
+#include <sys/time.h>
+
+namespace
+{
+void WriteUInt16(char* output, unsigned int value)
+{
+  output[0] = (char)((value >> 8) & 0xFF);
+  output[1] = (char)(value & 0xFF);
+}
+
+
+void WriteUInt32(char* output, unsigned int value)
+{
+  output[0] = (char)((value >> 24) & 0xFF);
+  output[1] = (char)((value >> 16) & 0xFF);
+  output[2] = (char)((value >> 8) & 0xFF);
+  output[3] = (char)(value & 0xFF);
+}
+}
+
+UdpFragmenter::UdpFragmenter() : SessionId((unsigned int)GetTimestamp())
+{
+}
+
+
+int UdpFragmenter::Fragment(const QByteArray& frame, unsigned int frame_id, unsigned long long timestamp)
+{
+  const int FragmentCount = (frame.size()+PayloadSize-1) / PayloadSize;
+
+  if (FragmentCount <= 0 || FragmentCount > 0xFFFF)
+    return 0;
+
+  // The datagram buffer is reused between the frames
+  Buffer.resize(FragmentCount*(HeaderSize+PayloadSize));
+  Sizes.resize(FragmentCount);
+  for (int i = 0; i < FragmentCount; ++i)
+  {
+    char* Datagram = &Buffer[i*(HeaderSize+PayloadSize)];
+    const int Offset = i*PayloadSize;
+    const int Size = frame.size()-Offset < PayloadSize ? frame.size()-Offset : PayloadSize;
+
+    WriteUInt32(Datagram, SessionId);
+    WriteUInt32(Datagram+4, frame_id);
+    WriteUInt16(Datagram+8, i);
+    WriteUInt16(Datagram+10, FragmentCount);
+    WriteUInt32(Datagram+12, frame.size());
+    WriteUInt32(Datagram+16, (unsigned int)(timestamp >> 32));
+    WriteUInt32(Datagram+20, (unsigned int)(timestamp & 0xFFFFFFFF));
+    memcpy(Datagram+HeaderSize, frame.constData()+Offset, Size);
+    Sizes[i] = HeaderSize+Size;
+  }
+  return FragmentCount;
+}
+
+
+const char* UdpFragmenter::GetDatagram(int index) const
+{
+  return &Buffer[index*(HeaderSize+PayloadSize)];
+}
+
+
+int UdpFragmenter::GetDatagramSize(int index) const
+{
+  return Sizes[index];
+}
+
+
+unsigned long long UdpFragmenter::GetTimestamp()
+{
+  timeval Time;
+
+  gettimeofday(&Time, NULL);
+  return (unsigned long long)Time.tv_sec*1000000+Time.tv_usec;
+}
@@ -0,0 +1,61 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef UdpFragmenter_hpp
+#define UdpFragmenter_hpp
+
+#include <qbytearray.h>
+
+#include <vector>
+
+/**
+ * Splits the encoded frames into datagrams for the UDP transport of the image stream.
+ *
+ * Every datagram starts with a header (all numbers are big-endian):
+ *
+ *   uint32 session id, uint32 frame id, uint16 fragment index, uint16 fragment count,
+ *   uint32 frame size, uint64 send time (microseconds of the wall clock)
+ *
+ * followed by at most PayloadSize bytes of the frame. The fragments fit into
+ * an ethernet MTU without IP fragmentation. The session id is chosen when the
+ * fragmenter is created, the receiver restarts the frame ids when it changes.
+ */
+class UdpFragmenter
+{
+public:
+  static const int HeaderSize = 24;
+  static const int PayloadSize = 1400;
+
+  UdpFragmenter();
+
+  int Fragment(const QByteArray& frame, unsigned int frame_id, unsigned long long timestamp);
+  const char* GetDatagram(int index) const;
+  int GetDatagramSize(int index) const;
+
+  static unsigned long long GetTimestamp();
+
+protected:
+  const unsigned int SessionId;
+  std::vector<char> Buffer;
+  std::vector<int> Sizes;
+};
+
+#endif
@@ -0,0 +1,190 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "UdpReassembler.hpp"
+
+#include "UdpFragmenter.hpp"
+
+#include <string.h>
+
+namespace
+{
+unsigned int ReadUInt16(const char* input)
+{
+  const unsigned char* Data = (const unsigned char*)input;
+
+  return (Data[0] << 8) | Data[1];
+}
+
+
+unsigned int ReadUInt32(const char* input)
+{
+  const unsigned char* Data = (const unsigned char*)input;
+
+  return ((unsigned int)Data[0] << 24) | (Data[1] << 16) | (Data[2] << 8) | Data[3];
+}
+}
+
+UdpReassembler::UdpReassembler(int max_partial_frames) : MaxPartialFrames(max_partial_frames), SessionStarted(false),
+  SessionId(0), PreviousSessionId(0), FrameCompleted(false), LastFrameId(0)
+{
+  memset(&Stats, 0, sizeof(Stats));
+}
+
+
+bool UdpReassembler::AddDatagram(const char* data, int size, QByteArray& frame, unsigned int& frame_id,
+                                 unsigned long long& timestamp)
+{
+  if (size <= UdpFragmenter::HeaderSize)
+  {
+    Stats.InvalidDatagrams++;
+    return false;
+  }
+  const unsigned int Session = ReadUInt32(data);
+  const unsigned int FrameId = ReadUInt32(data+4);
+  const int Index = ReadUInt16(data+8);
+  const int Count = ReadUInt16(data+10);
+  const int FrameSize = ReadUInt32(data+12);
+  const int Offset = Index*UdpFragmenter::PayloadSize;
+  const int PayloadSize = size-UdpFragmenter::HeaderSize;
+
+  if (Count == 0 || Index >= Count || FrameSize <= 0 || FrameSize > Count*UdpFragmenter::PayloadSize ||
+      Offset+PayloadSize > FrameSize || (Index < Count-1 && PayloadSize != UdpFragmenter::PayloadSize))
+  {
+    Stats.InvalidDatagrams++;
+    return false;
+  }
+  if (!SessionStarted || Session != SessionId)
+  {
+    // The fragments of the replaced session arrive late after a sender restart
+    if (SessionStarted && Session == PreviousSessionId)
+    {
+      Stats.LateDatagrams++;
+      return false;
+    }
+    StartSession(Session);
+  }
+  // A newer frame is already complete
+  if (FrameCompleted && !IsOlder(LastFrameId, FrameId))
+  {
+    Stats.LateDatagrams++;
+    return false;
+  }
+  PartialFrameMap::iterator Iter = PartialFrames.find(FrameId);
+
+  if (Iter == PartialFrames.end())
+  {
+    // Keep only the newest incomplete frames
+    while ((int)PartialFrames.size() >= MaxPartialFrames)
+    {
+      PartialFrameMap::iterator Oldest = PartialFrames.begin();
+
+      for (PartialFrameMap::iterator Iter2 = PartialFrames.begin(); Iter2 != PartialFrames.end(); ++Iter2)
+      {
+        if (IsOlder(Iter2->first, Oldest->first))
+          Oldest = Iter2;
+      }
+      PartialFrames.erase(Oldest);
+      Stats.DroppedFrames++;
+    }
+    PartialFrame& NewFrame = PartialFrames[FrameId];
+
+    NewFrame.FragmentCount = Count;
+    NewFrame.ReceivedCount = 0;
+    NewFrame.Timestamp = ((unsigned long long)ReadUInt32(data+16) << 32) | ReadUInt32(data+20);
+    NewFrame.Data.resize(FrameSize);
+    NewFrame.Received.assign(Count, false);
+    Iter = PartialFrames.find(FrameId);
+  }
+  PartialFrame& Current = Iter->second;
+
+  if (Current.FragmentCount != Count || Current.Data.size() != FrameSize)
+  {
+    Stats.InvalidDatagrams++;
+    return false;
+  }
+  // Duplicated fragment
+  if (Current.Received[Index])
+    return false;
+
+  memcpy(Current.Data.data()+Offset, data+UdpFragmenter::HeaderSize, PayloadSize);
+  Current.Received[Index] = true;
+  Current.ReceivedCount++;
+  if (Current.ReceivedCount < Current.FragmentCount)
+    return false;
+
+  frame = Current.Data;
+  frame_id = FrameId;
+  timestamp = Current.Timestamp;
+  if (FrameCompleted)
+    Stats.LostFrames += (int)(FrameId-LastFrameId-1);
+  Stats.CompletedFrames++;
+  FrameCompleted = true;
+  LastFrameId = FrameId;
+  PartialFrames.erase(Iter);
+  DropOlderFrames(FrameId);
+  return true;
+}
+
+
+const UdpReassembler::Statistics& UdpReassembler::GetStatistics() const
+{
+  return Stats;
+}
+
+
+void UdpReassembler::StartSession(unsigned int session_id)
+{
+  if (SessionStarted)
+  {
+    Stats.DroppedFrames += (int)PartialFrames.size();
+    Stats.SessionChanges++;
+  }
+  PreviousSessionId = SessionId;
+  SessionId = session_id;
+  SessionStarted = true;
+  PartialFrames.clear();
+  FrameCompleted = false;
+}
+
+
+bool UdpReassembler::IsOlder(unsigned int frame_id, unsigned int reference) const
+{
+  // The frame ids can wrap around
+  return (int)(frame_id-reference) < 0;
+}
+
+
+void UdpReassembler::DropOlderFrames(unsigned int frame_id)
+{
+  PartialFrameMap::iterator Iter = PartialFrames.begin();
+
+  while (Iter != PartialFrames.end())
+  {
+    if (IsOlder(Iter->first, frame_id))
+    {
+      PartialFrames.erase(Iter++);
+      Stats.DroppedFrames++;
+    } else {
+      ++Iter;
+    }
+  }
+}
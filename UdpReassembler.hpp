@@ -0,0 +1,84 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef UdpReassembler_hpp
+#define UdpReassembler_hpp
+
+#include <qbytearray.h>
+
+#include <map>
+#include <vector>
+
+/**
+ * Reassembles the frames of the UDP transport from their fragments (see UdpFragmenter).
+ *
+ * The fragments can arrive in any order. When a frame is complete, the incomplete
+ * older frames are dropped and the late fragments of older frames are ignored.
+ * A new session id means a restarted sender: the frame ids start again and the
+ * late fragments of the previous session are ignored.
+ */
+class UdpReassembler
+{
+public:
+  struct Statistics
+  {
+    int CompletedFrames;
+    // The frames skipped between the completed ones (dropped or not seen at all)
+    int LostFrames;
+    // The incomplete frames which were dropped
+    int DroppedFrames;
+    int LateDatagrams;
+    int InvalidDatagrams;
+    int SessionChanges;
+  };
+
+  UdpReassembler(int max_partial_frames);
+
+  bool AddDatagram(const char* data, int size, QByteArray& frame, unsigned int& frame_id,
+                   unsigned long long& timestamp);
+  const Statistics& GetStatistics() const;
+
+protected:
+  struct PartialFrame
+  {
+    int FragmentCount;
+    int ReceivedCount;
+    unsigned long long Timestamp;
+    QByteArray Data;
+    std::vector<bool> Received;
+  };
+  typedef std::map<unsigned int, PartialFrame> PartialFrameMap;
+
+  void StartSession(unsigned int session_id);
+  bool IsOlder(unsigned int frame_id, unsigned int reference) const;
+  void DropOlderFrames(unsigned int frame_id);
+
+  const int MaxPartialFrames;
+  PartialFrameMap PartialFrames;
+  bool SessionStarted;
+  unsigned int SessionId;
+  unsigned int PreviousSessionId;
+  bool FrameCompleted;
+  unsigned int LastFrameId;
+  Statistics Stats;
+};
+
+#endif
@@ -0,0 +1,167 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#include "UdpReceiver.hpp"
+
+#include "UdpFragmenter.hpp"
+
+#include <MCLog.hpp>
+
+#include <qelapsedtimer.h>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+namespace
+{
+// Maximal number of the incomplete frames at the same time
+const int MaxPartialFrames = 4;
+// Period of the report (ms)
+const int ReportInterval = 5000;
+// Receive buffer of the socket
+const int ReceiveBufferSize = 4*1024*1024;
+}
+
+UdpReceiver::UdpReceiver(int port) : Port(port), Reassembler(MaxPartialFrames),
+  Datagram(UdpFragmenter::HeaderSize+UdpFragmenter::PayloadSize)
+{
+}
+
+
+bool UdpReceiver::Run()
+{
+  const int Socket = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in Address;
+
+  memset(&Address, 0, sizeof(Address));
+  Address.sin_family = AF_INET;
+  Address.sin_addr.s_addr = htonl(INADDR_ANY);
+  Address.sin_port = htons(Port);
+  if (Socket < 0 || bind(Socket, (sockaddr*)&Address, sizeof(Address)) != 0)
+  {
+    MC_LOG("Cannot receive on UDP port %d: %s", Port, strerror(errno));
+    if (Socket >= 0)
+      close(Socket);
+    return false;
+  }
+  timeval Timeout;
+
+  // The receive times out to report even without traffic
+  Timeout.tv_sec = 1;
+  Timeout.tv_usec = 0;
+  setsockopt(Socket, SOL_SOCKET, SO_RCVBUF, &ReceiveBufferSize, sizeof(ReceiveBufferSize));
+  setsockopt(Socket, SOL_SOCKET, SO_RCVTIMEO, &Timeout, sizeof(Timeout));
+
+  UdpReassembler::Statistics Previous = Reassembler.GetStatistics();
+  QElapsedTimer ReportTimer;
+  QByteArray Frame;
+  long long ByteCount = 0;
+  double LatencySum = 0;
+  double MaxLatency = 0;
+  int TileFrames = 0;
+  int TileKeyframes = 0;
+  int TileCount = 0;
+  int TileFailures = 0;
+  bool HasPreviousFrame = false;
+  unsigned int PreviousFrameId = 0;
+
+  MC_LOG("Receiving the UDP image stream on port %d", Port);
+  ReportTimer.start();
+  while (true)
+  {
+    const ssize_t Size = recv(Socket, &Datagram[0], Datagram.size(), 0);
+    unsigned int FrameId = 0;
+    unsigned long long Timestamp = 0;
+
+    if (Size < 0 && errno != EINTR && errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+      MC_LOG("UDP receive failed: %s", strerror(errno));
+      break;
+    }
+    if (Size > 0 && Reassembler.AddDatagram(&Datagram[0], (int)Size, Frame, FrameId, Timestamp))
+    {
+      const double Latency = (double)((long long)(UdpFragmenter::GetTimestamp()-Timestamp)) / 1000;
+
+      ByteCount += Frame.size();
+      LatencySum += Latency;
+      MaxLatency = std::max(MaxLatency, Latency);
+      // A lost frame of the delta stream breaks the frames until the next keyframe
+      if (TileDeltaDecoder::IsTileMessage(Frame))
+      {
+        bool Keyframe = false;
+        int Count = 0;
+
+        // The deltas after a gap would be drawn onto a stale frame, the decoder waits for a keyframe
+        if (HasPreviousFrame && FrameId != PreviousFrameId+1)
+          Tiles.Reset();
+
+        if (Tiles.Decode(Frame, Keyframe, Count))
+        {
+          TileFrames++;
+          TileKeyframes += Keyframe ? 1 : 0;
+          TileCount += Count;
+        } else {
+          TileFailures++;
+        }
+      }
+      HasPreviousFrame = true;
+      PreviousFrameId = FrameId;
+    }
+    if (ReportTimer.elapsed() < ReportInterval)
+      continue;
+
+    const UdpReassembler::Statistics& Current = Reassembler.GetStatistics();
+    const int Completed = Current.CompletedFrames-Previous.CompletedFrames;
+    const int Lost = Current.LostFrames-Previous.LostFrames;
+    const float Seconds = (float)ReportTimer.elapsed() / 1000;
+
+    MC_LOG("UDP stream: %1.2f fps, %1.0f bytes/s, %1.2f%% frames lost (%d incomplete, %d late datagrams)",
+           Completed / Seconds, ByteCount / Seconds, Completed+Lost > 0 ? (float)Lost*100 / (Completed+Lost) : 0.0,
+           Current.DroppedFrames-Previous.DroppedFrames, Current.LateDatagrams-Previous.LateDatagrams);
+    MC_LOG("UDP stream latency (wall clocks of the sender and the receiver): %1.2f ms (average), %1.2f ms (max)",
+           Completed > 0 ? LatencySum / Completed : 0.0, MaxLatency);
+    if (Current.SessionChanges != Previous.SessionChanges)
+      MC_LOG("UDP stream: the sender restarted");
+    if (TileFrames+TileFailures > 0)
+    {
+      MC_LOG("UDP stream tiles: %d frames rebuilt (%d keyframes, %1.1f tiles/frame), %d not decodable",
+             TileFrames, TileKeyframes, TileFrames > 0 ? (float)TileCount / TileFrames : 0.0, TileFailures);
+    }
+    Previous = Current;
+    ByteCount = 0;
+    LatencySum = 0;
+    MaxLatency = 0;
+    TileFrames = 0;
+    TileKeyframes = 0;
+    TileCount = 0;
+    TileFailures = 0;
+    ReportTimer.start();
+  }
+  close(Socket);
+  return false;
+}
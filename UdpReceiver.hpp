@@ -0,0 +1,53 @@
+/*
+ *  This file is part of the iop-server
+ *
+ *  Copyright (C) 2015-2016 Csaba Kertész (csaba.kertesz@gmail.com)
+ *
+ *  iop-server is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  iop-server is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Street #330, Boston, MA 02111-1307, USA.
+ *
+ */
+
+#ifndef UdpReceiver_hpp
+#define UdpReceiver_hpp
+
+#include "TileDeltaDecoder.hpp"
+#include "UdpReassembler.hpp"
+
+#include <vector>
+
+/**
+ * Reference receiver of the UDP image stream.
+ *
+ * It reassembles the frames and reports the frame rate, the frame loss and the
+ * latency from the send time. The latency compares the wall clocks of the sender
+ * and the receiver, it is exact only on the same host (e.g. on the loopback
+ * interface with netem impairment) or with synchronized clocks.
+ * The tile delta messages are decoded to check that the frames can be rebuilt.
+ */
+class UdpReceiver
+{
+public:
+  UdpReceiver(int port);
+
+  bool Run();
+
+protected:
+  const int Port;
+  UdpReassembler Reassembler;
+  TileDeltaDecoder Tiles;
+  std::vector<char> Datagram;
+};
+
+#endif
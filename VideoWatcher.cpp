@@ -21,57 +21,49 @@
 
 #include "VideoWatcher.hpp"
 
-#include "TableMarkers.hpp"
+#include "BallTracker.hpp"
+#include "OverlayLayer.hpp"
 
-#include <MECalibration.hpp>
 #include <MECapture.hpp>
 #include <MEImage.hpp>
-#include <MEMotionDetection.hpp>
 
-#include <MCBinaryData.hpp>
 #include <MCLog.hpp>
 
 #include <qcoreapplication.h>
+#include <qelapsedtimer.h>
 #include <qfile.h>
 #include <QtConcurrentRun>
 #include <qtimer.h>
 
-#include <opencv/cv.h>
-
 #include <boost/bind.hpp>
 
-VideoWatcher::VideoWatcher(const QString& video_file, bool normal_playback) : FrameWidth(320), FrameHeight(180),
-  FrameDuration(34), FrameCount(0), OverallFrameCount(0), WaitDuration(0), CaptureDevice(new MECapture),
-  CapturedImage(new MEImage), OriginalImage(new MEImage), FinalImage(new MEImage),
-  RotationAngle(MCFloatInfinity()), Undistort(true), DebugCorners(false), DebugMotions(false)
+#include <algorithm>
+
+namespace
 {
-  DebugMessageImage.reset(new MEImage(FrameWidth*2, FrameHeight*2, 3));
-  // Set the calibration data manually because the portable archive does not work by some reason
-//  MCBinaryData DataBuffer;
-
-//  DataBuffer.LoadFromQtResource(":/rpi.cal");
-//  Calibration.reset(MECalibration::Decode(DataBuffer));
-
-  MC::FloatTable Intrinsics;
-  MC::FloatList DistortionCoefficients;
-
-  Intrinsics.resize(3);
-  Intrinsics[0].push_back(166);
-  Intrinsics[0].push_back(0);
-  Intrinsics[0].push_back(160);
-  Intrinsics[1].push_back(0);
-  Intrinsics[1].push_back(154);
-  Intrinsics[1].push_back(90);
-  Intrinsics[2].push_back(0);
-  Intrinsics[2].push_back(0);
-  Intrinsics[2].push_back(1);
-  DistortionCoefficients.push_back(-0.12);
-  DistortionCoefficients.push_back(0.02);
-  DistortionCoefficients.push_back(0.030);
-  DistortionCoefficients.push_back(0.01);
-  DistortionCoefficients.push_back(0.03);
-  Calibration.reset(new MECalibration(FrameWidth, FrameHeight, Intrinsics, DistortionCoefficients));
+const char* CalibrationCacheFile = "calibration.cache";
+// Delay between the captures in the dark (ms)
+const int DarkCaptureDelay = 200;
+// Margin around the table for the ball tracking (in the analysed frame)
+const int BallRegionMargin = 15;
+}
 
+VideoWatcher::VideoWatcher(const QString& video_file, bool normal_playback) : FrameWidth(320), FrameHeight(180),
+  FrameDuration(34), FrameCount(0), OverallFrameCount(0), WaitDuration(0),
+  LiveCapture(video_file.isEmpty()), Brightness(0), CaptureTimestamp(0), CaptureDevice(new MECapture),
+  CapturedImage(new MEImage), FinalImage(new MEImage), FrameConverted(false), BallTrackingTime(0),
+  Undistort(true), DebugCorners(false), DebugMotions(false), DebugBall(false), TableMissing(false)
+{
+  DebugOverlay.reset(new OverlayLayer(2));
+  MissingTableOverlay.reset(new OverlayLayer(2));
+  MissingTableOverlay->AddText(80, 160, "Table not detected", 1, MEColor(255, 255, 255), true);
+  BallOverlay.reset(new OverlayLayer(1));
+  CorrectedBallOverlay.reset(new OverlayLayer(1));
+  // Set the ball tracking
+  Ball.reset(new BallTracker);
+  // Set the frame analysis
+  Analyzer.reset(new FrameAnalyzer(FrameWidth, FrameHeight, true));
+  Analyzer->UseCalibrationCache(CalibrationCacheFile);
   // Start the capture device
   if (!video_file.isEmpty())
   {
@@ -88,17 +80,12 @@ VideoWatcher::VideoWatcher(const QString& video_file, bool normal_playback) : Fr
     CaptureDevice->Start(0);
   }
   FpsTimer.start();
+  CaptureClock.start();
   // Start the capture device
   QFuture<void> CaptureTask = QtConcurrent::run(boost::bind(&VideoWatcher::CaptureImage, this));
 
   connect(&CaptureWatcher, SIGNAL(finished()), this, SLOT(CaptureFinished()));
   CaptureWatcher.setFuture(CaptureTask);
-  // Set table marker finder
-  Markers.reset(new TableMarkers(FrameWidth, FrameHeight));
-  // Set motion detection
-  MotionDetection.reset(new MEMotionDetection);
-  MotionDetection->SetParameter(MEMotionDetection::mdp_HUHistogramsPerPixel, (float)4);
-  MotionDetection->SetMode(MEMotionDetection::md_LBPHistograms);
 }
 
 
@@ -107,16 +94,67 @@ VideoWatcher::~VideoWatcher()
 }
 
 
-const MEImage& VideoWatcher::GetCapturedImage()
+FrameHandle VideoWatcher::GetCapturedFrame()
 {
   if (DebugCorners || DebugMotions)
   {
-    FinalImage->Resize(FrameWidth*2, FrameHeight*2);
-    FinalImage->Addition(*DebugMessageImage, ME::MaskAddition);
-    return *FinalImage;
+    FrameHandle DebugFrame(new MEImage(*FinalImage), CurrentFrame.GetSequence());
+    MEImage& Image = DebugFrame.Detach();
+
+    Image.Resize(FrameWidth*2, FrameHeight*2);
+    DebugOverlay->Composite(Image);
+    if (TableMissing)
+      MissingTableOverlay->Composite(Image);
+    if (DebugBall)
+      CorrectedBallOverlay->Composite(Image);
+    return DebugFrame;
   }
+  ConvertCurrentFrame();
+  if (DebugBall && !BallOverlay->IsEmpty())
+  {
+    FrameHandle BallFrame = CurrentFrame;
+
+    BallOverlay->Composite(BallFrame.Detach());
+    return BallFrame;
+  }
+  return CurrentFrame;
+}
 
-  return *OriginalImage;
+
+const FrameResult& VideoWatcher::GetFrameResult() const
+{
+  // The result of the last analysed frame, the corners are in the corrected analysis frame
+  return LastResult;
+}
+
+
+void VideoWatcher::GetCaptureCorners(float* corners) const
+{
+  // Map the table corners of the last result to the pixels of the raw capture
+  const MEImage& Image = CurrentFrame.GetImage();
+  const float ScaleX = (float)Image.GetWidth() / FrameWidth;
+  const float ScaleY = (float)Image.GetHeight() / FrameHeight;
+
+  for (int i = 0; i < 4; ++i)
+  {
+    Analyzer->MapToRawFrame(LastResult.Corners[i].X, LastResult.Corners[i].Y, corners[i*2], corners[i*2+1]);
+    corners[i*2] *= ScaleX;
+    corners[i*2+1] *= ScaleY;
+  }
+}
+
+
+bool VideoWatcher::IsDebugView() const
+{
+  // GetCapturedFrame() returns the corrected analysis frame with the debug signs
+  return DebugCorners || DebugMotions;
+}
+
+
+qint64 VideoWatcher::GetCaptureAge() const
+{
+  // Microseconds since the current frame was captured
+  return CaptureAge.nsecsElapsed() / 1000;
 }
 
 
@@ -132,10 +170,32 @@ void VideoWatcher::CaptureImage()
 }
 
 
+void VideoWatcher::ConvertCurrentFrame()
+{
+  if (FrameConverted)
+    return;
+
+  // The frame has not been handed out yet, the conversion does not copy it
+  CurrentFrame.Detach().ConvertBGRToRGB();
+  FrameConverted = true;
+}
+
+
+void VideoWatcher::StartCapture()
+{
+  QFuture<void> CaptureTask = QtConcurrent::run(boost::bind(&VideoWatcher::CaptureImage, this));
+
+  CaptureWatcher.setFuture(CaptureTask);
+}
+
+
 void VideoWatcher::CaptureFinished()
 {
-  QFuture<void> CaptureTask;
   static bool AudioStarted = false;
+  // Stamp the frame before any processing, the ball positions and the shared frames are timed with it
+  const int CaptureTime = (int)CaptureClock.elapsed();
+
+  CaptureAge.start();
 
   // In debug mode, keep the audio and video playback in sync
   if (WaitDuration > 0)
@@ -143,20 +203,38 @@ void VideoWatcher::CaptureFinished()
 
   FrameCount++;
   OverallFrameCount++;
-  *OriginalImage = *CapturedImage;
+  CaptureTimestamp = LiveCapture ? CaptureTime : (int)(FrameDuration*OverallFrameCount);
+  // Hand the captured buffer over to the current frame without a copy
+  FrameHandle PreviousFrame = CurrentFrame;
+
+  CurrentFrame = FrameHandle(CapturedImage, OverallFrameCount);
+  FrameConverted = false;
+  // Reuse the buffer of the previous frame for the next capture if no one holds it anymore
+  CapturedImage = PreviousFrame.ReleaseBuffer();
   if (AudioStarted == false)
   {
     QTimer::singleShot(100, this, SIGNAL(StartAudio()));
     AudioStarted = true;
   }
-  // Start a new capture
-  CaptureTask = QtConcurrent::run(boost::bind(&VideoWatcher::CaptureImage, this));
-  CaptureWatcher.setFuture(CaptureTask);
-  if (FrameCount % 3 == 1)
+  // Check if the lights are off on a sparse subsample of the raw capture
+  Brightness = FrameAnalyzer::SampleBrightness(CurrentFrame.GetImage());
+  // Start a new capture, the live capture slows down in the dark
+  if (LiveCapture && FrameAnalyzer::IsDark(Brightness))
+    QTimer::singleShot(DarkCaptureDelay, this, SLOT(StartCapture()));
+  else
+    StartCapture();
+  // The ball tracking runs on every captured frame
+  if (FrameAnalyzer::IsDark(Brightness))
+    Ball->Reset();
+  else
+    TrackBall();
+  // Process every frame in the dark to notice the lights on immediately
+  if (FrameCount % 3 == 1 && !Analyzer->IsLightsOff())
+  {
+    Q_EMIT(VideoEvent(IOP::SkippedFrameEvent));
     return;
+  }
 
-  OriginalImage->ConvertBGRToRGB();
-  *FinalImage = *OriginalImage;
   CheckFiles();
   // Check if the capture process stopped by some reason
   if (!CaptureDevice->IsCapturing())
@@ -164,25 +242,12 @@ void VideoWatcher::CaptureFinished()
     MC_LOG("Capture stopped");
     QCoreApplication::quit();
   }
-  // Be sure that the image has the expected size
-  if (FinalImage->GetWidth() != FrameWidth && FinalImage->GetHeight() != FrameHeight)
-  {
-    FinalImage->Resize(FrameWidth, FrameHeight);
-  }
-  if (Undistort && FinalImage->GetWidth() == FrameWidth && FinalImage->GetHeight() == FrameHeight)
-  {
-    Calibration->Undistort(*FinalImage);
-    // TODO: The rotational correction is too CPU expensive
-    if (!MCIsFloatInfinity(RotationAngle))
-    {
-      FinalImage->Rotate(RotationCenter.X, RotationCenter.Y, RotationAngle);
-    }
-  }
-  // Check if the lights are off
-  if (FinalImage->AverageBrightnessLevel() < 10)
+  FrameResult Result;
+
+  Analyzer->Analyze(CurrentFrame.GetImage(), Brightness, Result);
+  LastResult = Result;
+  if (Result.Dark)
   {
-    Markers->Reset();
-    MotionDetection->Reset();
     Q_EMIT(VideoEvent(IOP::IdleEvent));
     Q_EMIT(VideoEvent(IOP::CaptureEvent));
     return;
@@ -193,44 +258,38 @@ void VideoWatcher::CaptureFinished()
     MC_LOG("Capture speed: %1.2f fps", (float)1000 / FpsTimer.elapsed()*FrameCount);
     FpsTimer.start();
     FrameCount = 0;
-    MC_LOG("Average brightness level: %1.2f", FinalImage->AverageBrightnessLevel());
-  }
-  // Corner detection
-  Markers->AddImage(*FinalImage);
-  // TODO: The rotational correction is too CPU expensive
-  if (Markers->IsReady() && !Markers->IsAnyMissingCorner() && MCIsFloatInfinity(RotationAngle))
-  {
-    // Get the rotational angle and reset the marker detection
-    Markers->GetRotationalCorrection(*FinalImage, RotationAngle, RotationCenter);
-    MC_LOG("Detected rotation: %1.2f degrees", RotationAngle);
-    Markers->Reset();
+    MC_LOG("Average brightness level: %1.2f", Brightness);
+    MC_LOG("Ball tracking time: %1.3f ms/frame", (double)BallTrackingTime / 300 / 1000000);
+    BallTrackingTime = 0;
   }
-  // Motion detection
-  MEImage MotionFrame = *FinalImage;
-
-  MotionFrame.Resize(FrameWidth / 4, FrameHeight / 4);
-  MotionDetection->DetectMotions(MotionFrame);
   /*
    * Draw the debug signs and texts on the original image
    */
-  DebugMessageImage->Clear();
+  DebugOverlay->Clear();
+  TableMissing = false;
+  if (DebugCorners || DebugMotions)
+  {
+    ConvertCurrentFrame();
+    *FinalImage = CurrentFrame.GetImage();
+    FinalImage->Resize(FrameWidth, FrameHeight);
+    Analyzer->CorrectImage(*FinalImage);
+  }
   // Composite debug signs
   if (DebugMotions)
   {
     MEImage MaskImage;
 
-    MotionDetection->GetMotionsMask(MaskImage);
+    Analyzer->GetFrameMotionsMask(MaskImage);
     // Convert the grayscale image back to RGB
     MaskImage.ConvertToRGB();
-    MaskImage.Resize(FrameWidth, FrameHeight);
     FinalImage->Addition(MaskImage, ME::MaskAddition);
   }
   if (DebugCorners)
-    Markers->DrawDebugSigns(*FinalImage);
-  if (Markers->IsReady() && Markers->IsAnyMissingCorner())
+    Analyzer->GetMarkers().DrawDebugSigns(*DebugOverlay);
+  if (Result.MissingCorners)
   {
-    Markers->DrawMissingCorners(*FinalImage);
-    DebugMessageImage->DrawText(160, 320, "Table not detected", 1, MEColor(255, 255, 255));
+    Analyzer->GetMarkers().DrawMissingCorners(*DebugOverlay);
+    TableMissing = true;
     Q_EMIT(VideoEvent(IOP::MissingCornersEvent));
   }
   Q_EMIT(VideoEvent(IOP::NormalEvent));
@@ -238,16 +297,58 @@ void VideoWatcher::CaptureFinished()
 }
 
 
+void VideoWatcher::TrackBall()
+{
+  const MEImage& Image = CurrentFrame.GetImage();
+  int X1, Y1, X2, Y2;
+
+  BallOverlay->Clear();
+  CorrectedBallOverlay->Clear();
+  // Search the ball in the table region only, it is mapped from the corrected analysis frame to the raw capture
+  if (!Analyzer->GetRawTableRegion(BallRegionMargin, Image.GetWidth(), Image.GetHeight(), X1, Y1, X2, Y2))
+  {
+    if (Ball->IsTracking())
+      Ball->Reset();
+    return;
+  }
+  QElapsedTimer Timer;
+
+  Timer.start();
+  Ball->SetRegion(X1, Y1, X2, Y2);
+  if (Ball->Track(Image, CaptureTimestamp))
+  {
+    const BallTracker::Position& Position = Ball->GetPosition();
+
+    if (Position.Measured)
+      Q_EMIT(BallPosition(Position.Timestamp, Position.X, Position.Y));
+    if (DebugBall)
+    {
+      const MEColor Color = Position.Measured ? MEColor(255, 255, 0) : MEColor(255, 70, 70);
+      float X, Y;
+
+      BallOverlay->AddCircle((int)Position.X, (int)Position.Y, 6, Color);
+      // The debug view shows the corrected frame in double size
+      Analyzer->MapFromRawFrame(Position.X*FrameWidth / Image.GetWidth(),
+                                Position.Y*FrameHeight / Image.GetHeight(), X, Y);
+      CorrectedBallOverlay->AddCircle((int)(X*2), (int)(Y*2), 6, Color);
+    }
+  }
+  BallTrackingTime += Timer.nsecsElapsed();
+}
+
+
 void VideoWatcher::CheckFiles()
 {
   if (QFile("no_calibration").exists() && Undistort)
   {
     Undistort = false;
+    Analyzer->SetUndistort(false);
     MC_LOG("Disable the calibration");
   } else
   if (!QFile("no_calibration").exists() && !Undistort)
   {
     Undistort = true;
+    Analyzer->SetUndistort(true);
     MC_LOG("Enable the calibration");
   }
 
@@ -272,4 +373,15 @@ void VideoWatcher::CheckFiles()
     DebugMotions = false;
     MC_LOG("Disable motion detection debugging");
   }
+
+  if (QFile("debug_ball").exists() && !DebugBall)
+  {
+    DebugBall = true;
+    MC_LOG("Enable ball tracking debugging");
+  } else
+  if (!QFile("debug_ball").exists() && DebugBall)
+  {
+    DebugBall = false;
+    MC_LOG("Disable ball tracking debugging");
+  }
 }
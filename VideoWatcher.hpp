@@ -23,20 +23,21 @@
 #define VideoWatcher_hpp
 
 #include "Defines.hpp"
-
-#include <MEDefs.hpp>
+#include "FrameAnalyzer.hpp"
+#include "FrameHandle.hpp"
 
 #include <qfuturewatcher.h>
+#include <qelapsedtimer.h>
 #include <qobject.h>
 #include <QTime>
 
 #include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 
-class MECalibration;
+class BallTracker;
 class MECapture;
 class MEImage;
-class MEMotionDetection;
-class TableMarkers;
+class OverlayLayer;
 
 class VideoWatcher : public QObject
 {
@@ -46,19 +47,29 @@ public:
   VideoWatcher(const QString& video_file, bool normal_playback);
   virtual ~VideoWatcher();
 
-  const MEImage& GetCapturedImage();
+  FrameHandle GetCapturedFrame();
+  const FrameResult& GetFrameResult() const;
+  void GetCaptureCorners(float* corners) const;
+  bool IsDebugView() const;
+  qint64 GetCaptureAge() const;
 
 public Q_SLOTS:
   void CaptureFinished();
   void AudioTimestamp(int timestamp);
 
+private Q_SLOTS:
+  void StartCapture();
+
 private:
   void CaptureImage();
+  void ConvertCurrentFrame();
+  void TrackBall();
   void CheckFiles();
 
 Q_SIGNALS:
   void VideoEvent(IOP::VideoEventType event);
   void StartAudio();
+  void BallPosition(int timestamp, float x, float y);
 
 protected:
   const int FrameWidth;
@@ -67,21 +78,31 @@ protected:
   int FrameCount;
   int OverallFrameCount;
   int WaitDuration;
+  const bool LiveCapture;
+  float Brightness;
+  int CaptureTimestamp;
   QFutureWatcher<void> CaptureWatcher;
   boost::scoped_ptr<MECapture> CaptureDevice;
-  boost::scoped_ptr<MEImage> CapturedImage;
-  boost::scoped_ptr<MEImage> OriginalImage;
-  boost::scoped_ptr<MEImage> DebugMessageImage;
+  boost::shared_ptr<MEImage> CapturedImage;
+  FrameHandle CurrentFrame;
+  boost::scoped_ptr<OverlayLayer> DebugOverlay;
+  boost::scoped_ptr<OverlayLayer> MissingTableOverlay;
   boost::scoped_ptr<MEImage> FinalImage;
-  boost::scoped_ptr<MECalibration> Calibration;
-  boost::scoped_ptr<MEMotionDetection> MotionDetection;
-  boost::scoped_ptr<TableMarkers> Markers;
+  bool FrameConverted;
+  boost::scoped_ptr<FrameAnalyzer> Analyzer;
+  FrameResult LastResult;
+  boost::scoped_ptr<BallTracker> Ball;
+  boost::scoped_ptr<OverlayLayer> BallOverlay;
+  boost::scoped_ptr<OverlayLayer> CorrectedBallOverlay;
   QTime FpsTimer;
-  float RotationAngle;
-  MEPoint RotationCenter;
+  QElapsedTimer CaptureClock;
+  QElapsedTimer CaptureAge;
+  long long BallTrackingTime;
   bool Undistort;
   bool DebugCorners;
   bool DebugMotions;
+  bool DebugBall;
+  bool TableMissing;
 };
 
 #endif
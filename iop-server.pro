@@ -19,21 +19,73 @@ INCLUDEPATH += \
     /usr/include/libmindsession \
     /usr/include/libmindpiece
 
-LIBS += -lmindcommon -lmindaibo -lmindeye -lmindsession -lopencv_core -lopencv_imgproc
+LIBS += -lmindcommon -lmindaibo -lmindeye -lmindsession -lopencv_core -lopencv_imgproc -ljpeg -lrt
 
 SOURCES += \
     main.cpp \
     AudioWatcher.cpp \
+    BallTracker.cpp \
+    BroadcastServer.cpp \
+    BroadcastSubscriber.cpp \
+    CalibrationCache.cpp \
+    CornerAccumulator.cpp \
+    CornerBenchmark.cpp \
+    CornerFinder.cpp \
+    EncodedFrameCache.cpp \
+    FrameAnalyzer.cpp \
+    FrameHandle.cpp \
+    FrameItem.cpp \
+    FrameMailbox.cpp \
+    FrameStreamParser.cpp \
     GameWatcher.cpp \
     ImageSender.cpp \
+    JpegEncoder.cpp \
+    JpegRateController.cpp \
+    MotionDetector.cpp \
+    OfflineAnalyzer.cpp \
+    OverlayLayer.cpp \
+    SharedFrameMonitor.cpp \
+    SharedFrameRing.cpp \
     TableMarkers.cpp \
+    TableView.cpp \
+    TileDeltaDecoder.cpp \
+    TileDeltaEncoder.cpp \
+    UdpFragmenter.cpp \
+    UdpReassembler.cpp \
+    UdpReceiver.cpp \
     VideoWatcher.cpp
 
 HEADERS += \
     AudioWatcher.hpp \
+    BallTracker.hpp \
+    BroadcastServer.hpp \
+    BroadcastSubscriber.hpp \
+    CalibrationCache.hpp \
+    CornerAccumulator.hpp \
+    CornerBenchmark.hpp \
+    CornerFinder.hpp \
+    EncodedFrameCache.hpp \
+    FrameAnalyzer.hpp \
+    FrameHandle.hpp \
+    FrameItem.hpp \
+    FrameMailbox.hpp \
+    FrameStreamParser.hpp \
     GameWatcher.hpp \
     ImageSender.hpp \
+    JpegEncoder.hpp \
+    JpegRateController.hpp \
+    MotionDetector.hpp \
+    OfflineAnalyzer.hpp \
+    OverlayLayer.hpp \
+    SharedFrameMonitor.hpp \
+    SharedFrameRing.hpp \
     TableMarkers.hpp \
+    TableView.hpp \
+    TileDeltaDecoder.hpp \
+    TileDeltaEncoder.hpp \
+    UdpFragmenter.hpp \
+    UdpReassembler.hpp \
+    UdpReceiver.hpp \
     VideoWatcher.hpp
 
 RESOURCES += qml.qrc
@@ -19,7 +19,13 @@
  *
  */
 
+#include "BroadcastSubscriber.hpp"
+#include "CornerBenchmark.hpp"
+#include "FrameItem.hpp"
 #include "GameWatcher.hpp"
+#include "OfflineAnalyzer.hpp"
+#include "SharedFrameMonitor.hpp"
+#include "UdpReceiver.hpp"
 
 #include <MSContext.hpp>
 
@@ -29,6 +35,7 @@
 
 #include <qapplication.h>
 #include <qguiapplication.h>
+#include <qqml.h>
 #include <qqmlapplicationengine.h>
 #include <qquickwindow.h>
 
@@ -43,6 +50,17 @@ void Usage()
          "  -a, --audiofile STRING       Audio file for debugging\n"
          "  -v, --videofilename STRING   Video file for debugging\n"
          "  -i, --ipaddress STRING       IP address of the wall pi\n"
+         "  -r, --byterate NUMBER        Byte rate budget of the wall pi stream (default: 1000000)\n"
+         "  -t, --tiles                  Send only the changed tiles to the wall pi between keyframes\n"
+         "  -u, --udp                    Send the frames to the wall pi in UDP datagrams\n"
+         "  -x, --udpreceive NUMBER      Run as a test receiver of the UDP frame stream on a port\n"
+         "  -l, --listen NUMBER          Port of the frame broadcast for subscribers\n"
+         "  -c, --subscribe STRING       Run as a test subscriber of a broadcast server (host:port)\n"
+         "  -w, --slowdown NUMBER        Delay of the test subscriber after every frame (ms)\n"
+         "  -s, --sharedring STRING      Publish the frames into a shared memory ring (e.g. /iop-frames)\n"
+         "  -e, --readring STRING        Run as a test reader of a shared memory ring\n"
+         "  -o, --offline STRING         Analyse the video file offline into a CSV file\n"
+         "  -b, --benchmark NUMBER       Benchmark the corner search on the first frames of the video file\n"
          "  -d, --debug                  Debug mode with GUI\n"
          "  -h, --help                   Print this text\n"
          "\n\n");
@@ -60,6 +78,17 @@ int main(int argc, char *argv[])
   QString AudioFile;
   QString VideoFile;
   QString IPAddress;
+  QString OfflineFile;
+  int ByteRate = 1000000;
+  bool DeltaTiles = false;
+  bool UseUdp = false;
+  int UdpReceivePort = 0;
+  int BroadcastPort = 0;
+  QString SubscribeAddress;
+  int SubscriberDelay = 0;
+  QString SharedRingName;
+  QString ReadRingName;
+  int BenchmarkFrames = 0;
   bool DebugMode = false;
 
   MCLog::SetCustomHandler(new MALog(100000), true);
@@ -89,22 +118,147 @@ int main(int argc, char *argv[])
   {
     IPAddress = *Result.Parameter;
   }
+  // Scan for -r or --byterate argument
+  Result = Context->FindArgument("-r", "--byterate");
+  if (Result.SearchResult == MSContext::ca_ArgumentFoundWithParameter)
+  {
+    ByteRate = QString(*Result.Parameter).toInt();
+    if (ByteRate <= 0)
+    {
+      Usage();
+      return 1;
+    }
+  }
+  // Scan for -t or --tiles argument
+  Result = Context->FindArgument("-t", "--tiles");
+  if (Result.SearchResult != MSContext::ca_ArgumentNotFound)
+  {
+    DeltaTiles = true;
+  }
+  // Scan for -u or --udp argument
+  Result = Context->FindArgument("-u", "--udp");
+  if (Result.SearchResult != MSContext::ca_ArgumentNotFound)
+  {
+    UseUdp = true;
+  }
+  // Scan for -x or --udpreceive argument
+  Result = Context->FindArgument("-x", "--udpreceive");
+  if (Result.SearchResult == MSContext::ca_ArgumentFoundWithParameter)
+  {
+    UdpReceivePort = QString(*Result.Parameter).toInt();
+  }
+  // Scan for -l or --listen argument
+  Result = Context->FindArgument("-l", "--listen");
+  if (Result.SearchResult == MSContext::ca_ArgumentFoundWithParameter)
+  {
+    BroadcastPort = QString(*Result.Parameter).toInt();
+  }
+  // Scan for -c or --subscribe argument
+  Result = Context->FindArgument("-c", "--subscribe");
+  if (Result.SearchResult == MSContext::ca_ArgumentFoundWithParameter)
+  {
+    SubscribeAddress = *Result.Parameter;
+  }
+  // Scan for -w or --slowdown argument
+  Result = Context->FindArgument("-w", "--slowdown");
+  if (Result.SearchResult == MSContext::ca_ArgumentFoundWithParameter)
+  {
+    SubscriberDelay = QString(*Result.Parameter).toInt();
+  }
+  // Scan for -s or --sharedring argument
+  Result = Context->FindArgument("-s", "--sharedring");
+  if (Result.SearchResult == MSContext::ca_ArgumentFoundWithParameter)
+  {
+    SharedRingName = *Result.Parameter;
+  }
+  // Scan for -e or --readring argument
+  Result = Context->FindArgument("-e", "--readring");
+  if (Result.SearchResult == MSContext::ca_ArgumentFoundWithParameter)
+  {
+    ReadRingName = *Result.Parameter;
+  }
+  // Scan for -o or --offline argument
+  Result = Context->FindArgument("-o", "--offline");
+  if (Result.SearchResult == MSContext::ca_ArgumentFoundWithParameter)
+  {
+    OfflineFile = *Result.Parameter;
+  }
+  // Scan for -b or --benchmark argument
+  Result = Context->FindArgument("-b", "--benchmark");
+  if (Result.SearchResult == MSContext::ca_ArgumentFoundWithParameter)
+  {
+    BenchmarkFrames = QString(*Result.Parameter).toInt();
+  }
   // Scan for -d or --debug argument
   Result = Context->FindArgument("-d", "--debug");
   if (Result.SearchResult != MSContext::ca_ArgumentNotFound)
   {
     DebugMode = true;
   }
+  // Analyse a recorded match without the live pipeline
+  if (!OfflineFile.isEmpty())
+  {
+    if (VideoFile.isEmpty())
+    {
+      Usage();
+      return 1;
+    }
+    OfflineAnalyzer Analyzer(VideoFile, OfflineFile);
+
+    return Analyzer.Run() ? 0 : 1;
+  }
+  // Compare the corner search paths on a recorded match
+  if (BenchmarkFrames > 0)
+  {
+    if (VideoFile.isEmpty())
+    {
+      Usage();
+      return 1;
+    }
+    CornerBenchmark Benchmark(VideoFile, BenchmarkFrames);
+
+    return Benchmark.Run() ? 0 : 1;
+  }
+  // Watch the frame broadcast of an other server instance
+  if (!SubscribeAddress.isEmpty())
+  {
+    const int Separator = SubscribeAddress.indexOf(":");
+
+    if (Separator <= 0)
+    {
+      Usage();
+      return 1;
+    }
+    BroadcastSubscriber Subscriber(SubscribeAddress.left(Separator), SubscribeAddress.mid(Separator+1).toInt(),
+                                   SubscriberDelay);
+
+    return Subscriber.Run() ? 0 : 1;
+  }
+  // Read the shared frame ring of an other server instance
+  if (!ReadRingName.isEmpty())
+  {
+    SharedFrameMonitor Monitor(ReadRingName);
+
+    return Monitor.Run() ? 0 : 1;
+  }
+  // Receive the UDP frame stream in place of the wall pi
+  if (UdpReceivePort > 0)
+  {
+    UdpReceiver Receiver(UdpReceivePort);
+
+    return Receiver.Run() ? 0 : 1;
+  }
   QQmlApplicationEngine Engine;
   QQuickWindow* View = NULL;
 
   if (DebugMode)
   {
+    qmlRegisterType<FrameItem>("IOP", 1, 0, "FrameItem");
     Engine.load(QUrl(QStringLiteral("qrc:/main.qml")));
     View = qobject_cast<QQuickWindow*>(Engine.rootObjects()[0]);
-    Engine.addImageProvider(QLatin1String("camera"), new ImageProvider);
   }
-  GameWatcher Watcher(AudioFile, VideoFile, IPAddress, (DebugMode ? Engine.rootObjects()[0] : NULL));
+  GameWatcher Watcher(AudioFile, VideoFile, IPAddress, ByteRate, DeltaTiles, UseUdp, BroadcastPort, SharedRingName,
+                      (DebugMode ? Engine.rootObjects()[0] : NULL));
 
 //  if (DebugMode)
 //    View->showFullScreen();
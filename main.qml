@@ -1,5 +1,6 @@
 import QtQuick 2.0
 import QtQuick.Window 2.0
+import IOP 1.0
 
 Window {
     visible: true
@@ -10,17 +11,14 @@ Rectangle {
     id: fuckYoo
     objectName: "fuckYoo"
 
-    property alias cameraImage: cameraImage.source
-
     anchors.fill: parent
 
     // Camera image
-    Image {
-        id: cameraImage
+    FrameItem {
+        id: cameraFrame
+        objectName: "cameraFrame"
         anchors.fill: parent
-        smooth: true
         visible: true
-        source: "image://camera/image.png"
     }
 }
 